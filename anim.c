@@ -4,18 +4,17 @@
 
 #include "anim.h"
 #include "anim_fx.h"
+#include "anim_layer.h"
 #include "leds.h"
 #include <misc.h>
+#include <prng.h>
 #include <stdbool.h>
 #include <unistd.h>
-#include <limits.h>
 
 /** Animation thread state */
 struct anim_thread {
-    /** Array of indexes of LEDs that this thread modifies */
-    const uint8_t  *led_list;
-    /** Number of indexes of LEDs in led_list */
-    uint8_t         led_num;
+    /** Effect context, with the LEDs that this thread modifies */
+    struct anim_fx_ctx ctx;
     /** Current effect-stepping function */
     anim_fx_fn      fx;
     /**
@@ -24,80 +23,322 @@ struct anim_thread {
      */
     bool            first;
     /**
-     * Delay in milliseconds until the brightness of LEDs that this thread
-     * modifies becomes active, and the effect-stepping function is called.
+     * Number of the two LED banks yet to get the current state of the LEDs
+     * this thread modifies, as set when it's advanced, and counted down as
+     * they're rendered.
      */
-    unsigned int    delay;
+    uint8_t         stale;
+    /**
+     * True if the next state of the thread was rendered, as due at the
+     * step, so only the other bank is left to get it, once it's current.
+     */
+    bool            rendered_next;
+    /**
+     * Time in animation ticks since the animation start, when the brightness
+     * of LEDs that this thread modifies becomes active, and the
+     * effect-stepping function is called. Initialized to the delay from
+     * the start.
+     */
+    unsigned int    deadline;
+    /**
+     * Number of the thread's random number stream. Fixed per thread, so
+     * adding or changing other threads doesn't change its animation.
+     */
+    uint32_t        rng_stream;
+    /** Blend mode of the thread's layer over the layers of threads before */
+    enum anim_layer_blend   blend;
+    /** The thread's layer, covering the LEDs of the context's zone */
+    struct anim_layer       layer;
 };
 
-/** List of thread states */
+/**
+ * List of thread states. Threads' layers are composited in the list order,
+ * so a thread can overlay an effect on the zone of a thread before it, by
+ * animating the same LEDs, with a blend mode other than replace.
+ */
 static struct anim_thread  ANIM_THREADS[] = {
     {
-        .led_list = LEDS_STARS_LIST,
-        .led_num = LEDS_STARS_NUM,
+        .ctx = {
+            .led_list = LEDS_STARS_LIST,
+            .led_num = LEDS_STARS_NUM,
+            .arena = &ANIM_FX_STARS_ARENA,
+        },
         .fx = anim_fx_stars_shimmer,
         .first = true,
-        .delay = 0,
+        .deadline = 0,
+        .rng_stream = 1,
+        .blend = ANIM_LAYER_BLEND_REPLACE,
+    },
+    {
+        .ctx = {
+            .led_list = LEDS_STARS_LIST,
+            .led_num = LEDS_STARS_NUM,
+            .arena = &ANIM_FX_STARS_SPARKLE_ARENA,
+        },
+        .fx = anim_fx_stars_sparkle,
+        .first = true,
+        .deadline = ANIM_MS(3000),
+        .rng_stream = 4,
+        .blend = ANIM_LAYER_BLEND_MAX,
     },
     {
-        .led_list = LEDS_TOPPER_LIST,
-        .led_num = LEDS_TOPPER_NUM,
+        .ctx = {
+            .led_list = LEDS_TOPPER_LIST,
+            .led_num = LEDS_TOPPER_NUM,
+            .arena = &ANIM_FX_TOPPER_ARENA,
+        },
         .fx = anim_fx_topper_fade_in,
         .first = true,
-        .delay = 2800,
+        .deadline = ANIM_MS(2800),
+        .rng_stream = 2,
+        .blend = ANIM_LAYER_BLEND_REPLACE,
     },
     {
-        .led_list = LEDS_BALLS_LIST,
-        .led_num = LEDS_BALLS_NUM,
+        .ctx = {
+            .led_list = LEDS_BALLS_LIST,
+            .led_num = LEDS_BALLS_NUM,
+            .arena = &ANIM_FX_BALLS_ARENA,
+        },
         .fx = anim_fx_balls_fade_in_and_out,
         .first = true,
-        .delay = 1500,
+        .deadline = ANIM_MS(1500),
+        .rng_stream = 3,
+        .blend = ANIM_LAYER_BLEND_REPLACE,
     },
 };
 
-/** Delay until the next animation step across all threads */
-static unsigned int ANIM_DELAY = 0;
+/**
+ * Min-heap of the threads, by deadline, then by position in ANIM_THREADS,
+ * with the thread due first at the top.
+ */
+static struct anim_thread *ANIM_HEAP[ARRAY_SIZE(ANIM_THREADS)];
+
+/** Number of threads in ANIM_HEAP */
+static size_t ANIM_HEAP_NUM = 0;
+
+/** Time of the last animation step advanced to, since the start, ticks */
+static unsigned int ANIM_TIME = 0;
+
+/**
+ * Check if a thread is due before another one. Deadlines are compared
+ * accounting for wraparound, so threads must never be delayed by more than
+ * INT_MAX ticks.
+ *
+ * @param a The thread to check.
+ * @param b The thread to compare to.
+ *
+ * @return True if thread a is due before thread b, false otherwise.
+ */
+static inline bool
+anim_thread_before(const struct anim_thread *a, const struct anim_thread *b)
+{
+    return (int)(a->deadline - b->deadline) < 0 ||
+           (a->deadline == b->deadline && a < b);
+}
+
+/**
+ * Swap two threads in the heap.
+ *
+ * @param i Heap index of the first thread.
+ * @param j Heap index of the second thread.
+ */
+static inline void
+anim_heap_swap(size_t i, size_t j)
+{
+    struct anim_thread *thread = ANIM_HEAP[i];
+    ANIM_HEAP[i] = ANIM_HEAP[j];
+    ANIM_HEAP[j] = thread;
+}
+
+/**
+ * Add a thread to the heap.
+ *
+ * @param thread    The thread to add.
+ */
+static void
+anim_heap_push(struct anim_thread *thread)
+{
+    size_t i = ANIM_HEAP_NUM++;
+    size_t parent;
+
+    ANIM_HEAP[i] = thread;
+    for (; i > 0; i = parent) {
+        parent = (i - 1) / 2;
+        if (!anim_thread_before(ANIM_HEAP[i], ANIM_HEAP[parent])) {
+            break;
+        }
+        anim_heap_swap(i, parent);
+    }
+}
+
+/**
+ * Remove the thread due first from the heap.
+ *
+ * @return The removed thread.
+ */
+static struct anim_thread *
+anim_heap_pop(void)
+{
+    struct anim_thread *thread = ANIM_HEAP[0];
+    size_t i = 0;
+    size_t child;
+
+    ANIM_HEAP[0] = ANIM_HEAP[--ANIM_HEAP_NUM];
+    while ((child = i * 2 + 1) < ANIM_HEAP_NUM) {
+        if (child + 1 < ANIM_HEAP_NUM &&
+            anim_thread_before(ANIM_HEAP[child + 1], ANIM_HEAP[child])) {
+            child++;
+        }
+        if (!anim_thread_before(ANIM_HEAP[child], ANIM_HEAP[i])) {
+            break;
+        }
+        anim_heap_swap(i, child);
+        i = child;
+    }
+    return thread;
+}
+
+/**
+ * Composite the layers into the brightness of the specified LEDs, as of
+ * the current animation step, and render them into the inactive PWM data
+ * bank.
+ *
+ * @param led_list  Array of indexes of LEDs to composite and render.
+ * @param led_num   Number of LEDs in led_list.
+ */
+static void
+anim_composite_render(const leds_idx *led_list, uint8_t led_num)
+{
+    const struct anim_layer *layer_list[ARRAY_SIZE(ANIM_THREADS)];
+    const uint8_t *buf_list[ARRAY_SIZE(ANIM_THREADS)];
+    size_t layer_num = 0;
+    const struct anim_thread *thread;
+    const struct anim_layer *layer;
+    bool next;
+    leds_idx idx;
+    uint8_t br;
+    size_t i;
+    size_t j;
+
+    /*
+     * Take the state of each layer in effect at the step: the next one
+     * for threads due at it, skipping transparent states
+     */
+    for (i = 0; i < ARRAY_SIZE(ANIM_THREADS); i++) {
+        thread = &ANIM_THREADS[i];
+        next = thread->deadline == ANIM_TIME;
+        if (!anim_layer_transparent(&thread->layer, next)) {
+            layer_list[layer_num] = &thread->layer;
+            buf_list[layer_num] = next ? thread->layer.next
+                                       : thread->layer.cur;
+            layer_num++;
+        }
+    }
+
+    /* Blend each LED's layers bottom to top */
+    for (j = 0; j < led_num; j++) {
+        idx = led_list[j];
+        br = 0;
+        for (i = 0; i < layer_num; i++) {
+            layer = layer_list[i];
+            if (anim_layer_covers(layer, idx)) {
+                br = anim_layer_blend(layer->blend, br,
+                                      anim_layer_buf_get(buf_list[i], idx));
+            }
+        }
+        LEDS_BR[idx] = br;
+    }
+
+    leds_render_list(led_list, led_num);
+}
 
 void
 anim_init(void)
 {
+    uint32_t seed = prng_next();
+    struct anim_thread *thread;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(ANIM_THREADS); i++) {
+        thread = &ANIM_THREADS[i];
+        rng_init(&thread->ctx.rng, seed, thread->rng_stream);
+        anim_layer_init(&thread->layer, thread->blend,
+                        thread->ctx.led_list, thread->ctx.led_num);
+        thread->ctx.layer = &thread->layer;
+        anim_heap_push(thread);
+    }
 }
 
 unsigned int
-anim_step(void)
+anim_advance(void)
 {
+    /* Threads whose previous step is over */
+    struct anim_thread *due_list[ARRAY_SIZE(ANIM_THREADS)];
+    size_t due_num = 0;
     size_t i;
-    unsigned int delay_next;
+    unsigned int time_next;
+    unsigned int delay;
     struct anim_thread *thread;
     anim_fx_fn fx;
 
-    /* Advance each thread and calculate next delay */
-    delay_next = UINT_MAX;
-    for (i = 0; i < ARRAY_SIZE(ANIM_THREADS); i++) {
-        thread = &ANIM_THREADS[i];
-        thread->delay -= ANIM_DELAY;
-        /* If the previous thread step is over */
-        if (thread->delay == 0) {
-            /* Render the previous state into the swapped buffer */
-            leds_render_list(thread->led_list, thread->led_num);
-            /* Calculate next step */
-            fx = thread->fx;
-            thread->delay = fx(thread->first, (void **)&fx);
-            thread->first = thread->fx != fx;
-            thread->fx = fx;
-        }
-        if (thread->delay < delay_next) {
-            delay_next = thread->delay;
-        }
+    /* Take the threads whose previous step is over, in the list order */
+    while (ANIM_HEAP_NUM > 0 && ANIM_HEAP[0]->deadline == ANIM_TIME) {
+        due_list[due_num++] = anim_heap_pop();
     }
 
-    /* Render threads to come into effect next animation step */
+    /* Advance each of them, and put them back */
+    for (i = 0; i < due_num; i++) {
+        thread = due_list[i];
+        /* Have the state rendered into the banks which don't have it */
+        thread->stale = thread->rendered_next ? 1 : 2;
+        thread->rendered_next = false;
+        /* Keep the state while the next one is drawn */
+        anim_layer_commit(&thread->layer);
+        /* Calculate next step */
+        fx = thread->fx;
+        thread->deadline = ANIM_TIME + fx(&thread->ctx, thread->first,
+                                          (void **)&fx);
+        thread->first = thread->fx != fx;
+        thread->fx = fx;
+        anim_heap_push(thread);
+    }
+
+    time_next = ANIM_HEAP[0]->deadline;
+    delay = time_next - ANIM_TIME;
+    ANIM_TIME = time_next;
+    return delay;
+}
+
+void
+anim_render(void)
+{
+    struct anim_thread *thread;
+    size_t i;
+
+    /*
+     * Render threads with a state the swapped bank doesn't have yet, and
+     * threads to come into effect at the animation step. The layers hold
+     * the state in effect at the step, however many steps were advanced
+     * over.
+     */
     for (i = 0; i < ARRAY_SIZE(ANIM_THREADS); i++) {
         thread = &ANIM_THREADS[i];
-        if (thread->delay == delay_next) {
-            leds_render_list(thread->led_list, thread->led_num);
+        if (thread->stale > 0 || thread->deadline == ANIM_TIME) {
+            anim_composite_render(thread->ctx.led_list,
+                                  thread->ctx.led_num);
+            if (thread->stale > 0) {
+                thread->stale--;
+            }
+            thread->rendered_next = thread->deadline == ANIM_TIME;
         }
     }
+    leds_render_finish();
+}
 
-    return (ANIM_DELAY = delay_next);
+unsigned int
+anim_step(void)
+{
+    unsigned int delay = anim_advance();
+    anim_render();
+    return delay;
 }
@@ -5,6 +5,30 @@
 #ifndef _ANIM_H
 #define _ANIM_H
 
+#include "leds.h"
+
+/*
+ * Animation time is counted in ticks, 48 per millisecond, the SysTick
+ * tick rate with the default driver chain, so effects can time their
+ * steps to the PWM cycle the swaps happen at, without rounding to whole
+ * milliseconds.
+ */
+
+/** Number of animation ticks per millisecond */
+#define ANIM_MS_TICKS       48
+
+/**
+ * Convert milliseconds to animation ticks.
+ *
+ * @param _ms   The milliseconds to convert.
+ */
+#define ANIM_MS(_ms)        ((_ms) * ANIM_MS_TICKS)
+
+/**
+ * Number of animation ticks per PWM cycle (2.67ms, or 375Hz), the period
+ * of the LED bank swaps, at the default tick rate.
+ */
+#define ANIM_CYCLE_TICKS    (LEDS_PL_MAX * 2)
 
 /**
  * Initialize and begin animation.
@@ -14,9 +38,29 @@ extern void anim_init(void);
 /**
  * Draw the next animation step into the inactive LEDs bank.
  *
- * @return Time in milliseconds the rendered animation step
+ * @return Time in animation ticks the rendered animation step
  *         should begin output since the previous step had.
  */
 extern unsigned int anim_step(void);
 
+/**
+ * Advance to the next animation step, without drawing it. Any number of
+ * steps can be skipped this way, before drawing the last one with
+ * anim_render(), which also brings the inactive LEDs bank up to it from
+ * the steps skipped.
+ *
+ * @return Time in animation ticks the animation step should begin
+ *         output since the previous step had.
+ */
+extern unsigned int anim_advance(void);
+
+/**
+ * Draw the animation step advanced to with anim_advance() into the
+ * inactive LEDs bank, along with the LEDs changed by the steps advanced
+ * over since the previous draw. The bank drawn previously must have been
+ * swapped in since, as the LEDs it got are brought up to date in the other
+ * one.
+ */
+extern void anim_render(void);
+
 #endif /* _ANIM_H */
@@ -0,0 +1,192 @@
+/*
+ * Animation stream compiler
+ *
+ * Runs the animation effects through anim_step() on the host, and outputs
+ * the resulting animation stream (see anim_stream.h) as C source, for
+ * anim_play.c to play on the board.
+ *
+ * Usage: anim-compile SEED TIME
+ *
+ * SEED is the PRNG seed to run the effects with, and TIME is the duration
+ * of the stream, in milliseconds.
+ */
+#include "anim.h"
+#include "anim_stream.h"
+#include "leds.h"
+#include <prng.h>
+#include <misc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#if LEDS_CARD_NUM > 255
+#error "Animation stream supports up to 255 card LEDs"
+#endif
+
+/** Interval between key records, milliseconds */
+#define ANIM_COMPILE_KEY_INTERVAL   10000
+
+/** Maximum number of key records */
+#define ANIM_COMPILE_KEY_MAX        4096
+
+/**
+ * Brightness of the LEDs in the step being rendered by anim_step(), i.e.
+ * as it was when they were last composited and rendered.
+ */
+static uint8_t ANIM_COMPILE_BR[LEDS_NUM];
+
+/** List of key records output so far */
+static struct anim_stream_key ANIM_COMPILE_KEY_LIST[ANIM_COMPILE_KEY_MAX];
+
+/** Number of records in ANIM_COMPILE_KEY_LIST */
+static size_t ANIM_COMPILE_KEY_NUM;
+
+/** Number of stream bytes output so far */
+static uint32_t ANIM_COMPILE_LEN;
+
+extern void __real_leds_render_list(const leds_idx *list, size_t num);
+
+/**
+ * Render the list of LEDs, recording their brightness. Replaces
+ * leds_render_list() for anim_step(), with the --wrap linker option.
+ */
+void __wrap_leds_render_list(const leds_idx *list, size_t num);
+void
+__wrap_leds_render_list(const leds_idx *list, size_t num)
+{
+    size_t i;
+    for (i = 0; i < num; i++) {
+        ANIM_COMPILE_BR[list[i]] = LEDS_BR[list[i]];
+    }
+    __real_leds_render_list(list, num);
+}
+
+/**
+ * Output a stream byte.
+ *
+ * @param byte  The byte to output.
+ */
+static void
+anim_compile_byte(uint8_t byte)
+{
+    printf("%s0x%02x,", ANIM_COMPILE_LEN % 12 == 0 ? "\n   " : "", byte);
+    ANIM_COMPILE_LEN++;
+}
+
+/**
+ * Output a stream record. Only the card LEDs are recorded, as the effects
+ * don't animate any extra LEDs driven after them.
+ *
+ * @param delay The delay of the record since the previous one, ms.
+ * @param prev  Brightness of the LEDs in the previous record.
+ * @param key   True if the record should be a key record, listing all
+ *              LEDs, false if it should only list the changed ones.
+ */
+static void
+anim_compile_record(unsigned int delay, const uint8_t *prev, bool key)
+{
+    size_t i;
+    uint8_t idx_list[LEDS_CARD_NUM];
+    size_t idx_num = 0;
+
+    for (i = 0; i < LEDS_CARD_NUM; i++) {
+        if (key || ANIM_COMPILE_BR[i] != prev[i]) {
+            idx_list[idx_num++] = i;
+        }
+    }
+
+    do {
+        anim_compile_byte((delay & 0x7f) | (delay > 0x7f ? 0x80 : 0));
+        delay >>= 7;
+    } while (delay != 0);
+    anim_compile_byte(idx_num);
+    for (i = 0; i < idx_num; i++) {
+        anim_compile_byte(idx_list[i]);
+    }
+    for (i = 0; i < idx_num; i++) {
+        anim_compile_byte(ANIM_COMPILE_BR[idx_list[i]]);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    uint32_t seed;
+    unsigned int time_end;
+    unsigned int time = 0;
+    unsigned int ticks = 0;
+    unsigned int time_key = 0;
+    unsigned int time_first = 0;
+    unsigned int delay;
+    uint8_t prev[LEDS_NUM];
+    size_t i;
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s SEED TIME\n", argv[0]);
+        return 1;
+    }
+    seed = strtoul(argv[1], NULL, 0);
+    time_end = strtoul(argv[2], NULL, 0);
+
+    prng_seed(seed);
+    anim_init();
+
+    printf("/*\n"
+           " * Animation stream, seed %" PRIu32 ", %u ms\n"
+           " * Generated by anim-compile, do not edit\n"
+           " */\n"
+           "#include \"anim_stream.h\"\n"
+           "\n"
+           "const uint8_t ANIM_STREAM[] = {",
+           seed, time_end);
+
+    while (true) {
+        memcpy(prev, ANIM_COMPILE_BR, sizeof(prev));
+        delay = anim_step();
+        if ((ticks + delay) / ANIM_MS_TICKS >= time_end) {
+            break;
+        }
+        /* Round the step time down to ms, carrying the rest to the next */
+        ticks += delay;
+        delay = ticks / ANIM_MS_TICKS - time;
+        time += delay;
+        if (ANIM_COMPILE_LEN == 0) {
+            time_first = time;
+        }
+        if (time >= time_key) {
+            if (ANIM_COMPILE_KEY_NUM >= ARRAY_SIZE(ANIM_COMPILE_KEY_LIST)) {
+                fprintf(stderr, "Too many key records\n");
+                return 1;
+            }
+            ANIM_COMPILE_KEY_LIST[ANIM_COMPILE_KEY_NUM].time = time;
+            ANIM_COMPILE_KEY_LIST[ANIM_COMPILE_KEY_NUM].off =
+                                                        ANIM_COMPILE_LEN;
+            ANIM_COMPILE_KEY_NUM++;
+            anim_compile_record(delay, prev, true);
+            time_key = time + ANIM_COMPILE_KEY_INTERVAL;
+        } else {
+            anim_compile_record(delay, prev, false);
+        }
+    }
+
+    printf("\n};\n"
+           "\n"
+           "const size_t ANIM_STREAM_LEN = %" PRIu32 ";\n"
+           "\n"
+           "const unsigned int ANIM_STREAM_LOOP_DELAY = %u;\n"
+           "\n"
+           "const struct anim_stream_key ANIM_STREAM_KEY_LIST[] = {\n",
+           ANIM_COMPILE_LEN, time_end - time + time_first);
+    for (i = 0; i < ANIM_COMPILE_KEY_NUM; i++) {
+        printf("    {%" PRIu32 ", %" PRIu32 "},\n",
+               ANIM_COMPILE_KEY_LIST[i].time, ANIM_COMPILE_KEY_LIST[i].off);
+    }
+    printf("};\n"
+           "\n"
+           "const size_t ANIM_STREAM_KEY_NUM = %zu;\n",
+           ANIM_COMPILE_KEY_NUM);
+
+    return 0;
+}
@@ -5,101 +5,321 @@
 #include "anim_fx_script.h"
 #include "anim_fx.h"
 #include "leds.h"
-#include <prng.h>
 #include <misc.h>
 #include <unistd.h>
 #include <limits.h>
 
+/** Alignment of allocations in effect state arenas, bytes */
+#define ANIM_FX_ARENA_ALIGN sizeof(void *)
+
+/**
+ * Round an allocation size up to the arena alignment.
+ *
+ * @param _size The size to round, bytes.
+ */
+#define ANIM_FX_ARENA_ROUND(_size) \
+    (((_size) + ANIM_FX_ARENA_ALIGN - 1) & ~(ANIM_FX_ARENA_ALIGN - 1))
+
+/**
+ * Define an effect state arena.
+ *
+ * @param _name The arena variable name.
+ * @param _type The type the arena should be able to hold, usually a union
+ *              of the states of the effects using it.
+ */
+#define ANIM_FX_ARENA(_name, _type) \
+    static union {                                                      \
+        _type   state;                                                  \
+        void   *align;                                                  \
+        uint8_t buf[ANIM_FX_ARENA_ROUND(sizeof(_type))];                \
+    } _name##_BUF;                                                      \
+    struct anim_fx_arena _name = {                                      \
+        .size = sizeof(_name##_BUF),                                    \
+        .used = 0,                                                      \
+        .buf = _name##_BUF.buf,                                         \
+    }
+
+/**
+ * Allocate memory from an effect state arena.
+ *
+ * @param arena The arena to allocate from.
+ * @param size  Size of the memory to allocate, bytes.
+ *
+ * @return The allocated memory, or NULL if the arena is exhausted.
+ */
+static void *
+anim_fx_arena_alloc(struct anim_fx_arena *arena, size_t size)
+{
+    void *ptr;
+
+    size = ANIM_FX_ARENA_ROUND(size);
+    if (arena->size - arena->used < size) {
+        return NULL;
+    }
+    ptr = arena->buf + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+/**
+ * Start an effect in a context: reset its arena, dropping the previous
+ * effect's state, and allocate the new effect's state from it.
+ *
+ * @param ctx   The context to start the effect in.
+ * @param size  Size of the effect state, bytes.
+ *
+ * @return The allocated state, or NULL if the arena is exhausted.
+ */
+static void *
+anim_fx_ctx_start(struct anim_fx_ctx *ctx, size_t size)
+{
+    ctx->arena->used = 0;
+    ctx->state = anim_fx_arena_alloc(ctx->arena, size);
+    return ctx->state;
+}
+
 unsigned int
-anim_fx_stop(bool first, void **pnext_fx)
+anim_fx_stop(struct anim_fx_ctx *ctx, bool first, void **pnext_fx)
 {
+    (void)ctx;
     (void)first;
     (void)pnext_fx;
-    return 3600000;
+    return ANIM_MS(3600000);
 }
 
-unsigned int
-anim_fx_stars_shimmer(bool first, void **pnext_fx)
+/**
+ * Stop the effect, because its state arena is exhausted.
+ *
+ * @param pnext_fx  Location for the pointer to the next effect-stepping
+ *                  function.
+ *
+ * @return The delay before the next step.
+ */
+static unsigned int
+anim_fx_exhausted(void **pnext_fx)
 {
-    static struct anim_fx_script script;
-    static const struct anim_fx_script_seg seg_list[] = {
-        {.step_num_min = 1,
-         .step_num_max = 1,
-         .step_br_off = 0,
-         .step_delay_min = 5000,
-         .step_delay_max = 15000},
-        {.step_num_min = 5,
-         .step_num_max = 5,
-         .step_br_off = -3,
-         .step_delay_min = 40,
-         .step_delay_max = 40},
-        {.step_num_min = 1,
-         .step_num_max = 1,
-         .step_br_off = 0,
-         .step_delay_min = 400,
-         .step_delay_max = 1000},
-        {.step_num_min = 5,
-         .step_num_max = 5,
-         .step_br_off = 3,
-         .step_delay_min = 40,
-         .step_delay_max = 40}
-    };
-    static struct anim_fx_script_led led_list[LEDS_STARS_NUM];
-    static struct anim_fx_script_led_seg
-                            led_seg_list_list[LEDS_STARS_NUM *
-                                              ARRAY_SIZE(seg_list)];
+    *pnext_fx = anim_fx_stop;
+    return 0;
+}
+
+/**
+ * Size of a scripted effect state in an arena.
+ *
+ * @param _led_num  Number of LEDs animated by the script.
+ * @param _seg_num  Number of script segments.
+ */
+#define ANIM_FX_SCRIPT_SIZE(_led_num, _seg_num) \
+    (ANIM_FX_ARENA_ROUND(sizeof(struct anim_fx_script)) +               \
+     ANIM_FX_ARENA_ROUND(sizeof(struct anim_fx_script_led) *            \
+                         (_led_num)) +                                  \
+     ANIM_FX_ARENA_ROUND(sizeof(uint8_t) * (_led_num)) +                \
+     ANIM_FX_ARENA_ROUND(sizeof(struct anim_fx_script_led_seg) *        \
+                         (_led_num) * (_seg_num)))
+
+/**
+ * Step a scripted effect on the context's zone, starting it on the first
+ * step.
+ *
+ * @param ctx           The context of the thread running the effect.
+ * @param first         True if this is the first step.
+ * @param pnext_fx      Location of the pointer to the effect-stepping
+ *                      function, and for the pointer to the next one.
+ * @param seg_num       Number of script segments.
+ * @param seg_list      List of script segments [seg_num].
+ * @param br            Initial LED brightness.
+ * @param fade_delay    Fade-in/out delay, ticks.
+ * @param duration      Effect duration (excluding fade-in/out), ticks.
+ *                      UINT_MAX for infinity.
+ *
+ * @return The delay before the next step.
+ */
+static unsigned int
+anim_fx_script_run(struct anim_fx_ctx *ctx, bool first, void **pnext_fx,
+                   uint8_t seg_num, const struct anim_fx_script_seg *seg_list,
+                   uint8_t br, unsigned int fade_delay, unsigned int duration)
+{
+    struct anim_fx_script *script = ctx->state;
+    struct anim_fx_script_led *led_list;
+    uint8_t *led_heap;
+    struct anim_fx_script_led_seg *led_seg_list_list;
     unsigned int delay;
 
     if (first) {
-        anim_fx_script_init(
-                    &script, ARRAY_SIZE(seg_list), seg_list,
-                    LEDS_STARS_NUM, LEDS_STARS_LIST,
-                    led_list, led_seg_list_list,
+        script = anim_fx_ctx_start(ctx, sizeof(*script));
+        led_list = anim_fx_arena_alloc(ctx->arena,
+                                       sizeof(*led_list) * ctx->led_num);
+        led_heap = anim_fx_arena_alloc(ctx->arena,
+                                       sizeof(*led_heap) * ctx->led_num);
+        led_seg_list_list = anim_fx_arena_alloc(
+                                ctx->arena,
+                                sizeof(*led_seg_list_list) *
+                                ctx->led_num * seg_num);
+        if (script == NULL || led_list == NULL || led_heap == NULL ||
+            led_seg_list_list == NULL) {
+            return anim_fx_exhausted(pnext_fx);
+        }
+        anim_fx_script_init(script, seg_num, seg_list,
+                            ctx->led_num, ctx->led_list,
+                            led_list, led_heap, led_seg_list_list,
+                            br, fade_delay, duration,
+                            &ctx->rng, ctx->layer);
+    }
+
+    if (anim_fx_script_step(script, &delay)) {
+        *pnext_fx = anim_fx_balls_random;
+    }
+    return delay;
+}
+
+/** Segments of anim_fx_stars_shimmer() */
+static const struct anim_fx_script_seg ANIM_FX_STARS_SHIMMER_SEG_LIST[] = {
+    {.step_num_min = 1,
+     .step_num_max = 1,
+     .step_br_off = 0,
+     .step_delay_min = ANIM_MS(5000),
+     .step_delay_max = ANIM_MS(15000)},
+    {.step_num_min = 5,
+     .step_num_max = 5,
+     .step_br_off = LEDS_BR_FROM_64(-3),
+     .step_delay_min = ANIM_MS(40),
+     .step_delay_max = ANIM_MS(40)},
+    {.step_num_min = 1,
+     .step_num_max = 1,
+     .step_br_off = 0,
+     .step_delay_min = ANIM_MS(400),
+     .step_delay_max = ANIM_MS(1000)},
+    {.step_num_min = 5,
+     .step_num_max = 5,
+     .step_br_off = LEDS_BR_FROM_64(3),
+     .step_delay_min = ANIM_MS(40),
+     .step_delay_max = ANIM_MS(40)}
+};
+
+unsigned int
+anim_fx_stars_shimmer(struct anim_fx_ctx *ctx, bool first, void **pnext_fx)
+{
+    return anim_fx_script_run(
+                    ctx, first, pnext_fx,
+                    ARRAY_SIZE(ANIM_FX_STARS_SHIMMER_SEG_LIST),
+                    ANIM_FX_STARS_SHIMMER_SEG_LIST,
                     /* Initial brightness */
                     LEDS_BR_MAX * 3 / 4,
-                    /* Fade-in/out duration, ms */
-                    3000,
-                    /* Effect body duration, ms (infinity) */
+                    /* Fade-in/out duration, ticks */
+                    ANIM_MS(3000),
+                    /* Effect body duration, ticks (infinity) */
                     UINT_MAX);
+}
+
+/** Number of steps a star sparkle fades out over */
+#define ANIM_FX_STARS_SPARKLE_STEPS 8
+
+/** State of anim_fx_stars_sparkle() */
+struct anim_fx_stars_sparkle_state {
+    /** Index of the sparkling star in the zone */
+    uint8_t idx;
+    /** Number of the sparkle's fade-out steps left, zero if none */
+    uint8_t steps;
+};
+
+/**
+ * Get a random delay before the next star sparkle.
+ *
+ * @param ctx   The context of the thread running the effect.
+ *
+ * @return The delay, ticks.
+ */
+static unsigned int
+anim_fx_stars_sparkle_wait(struct anim_fx_ctx *ctx)
+{
+    return ANIM_MS(500) + rng_next(&ctx->rng, ANIM_MS(2500));
+}
+
+unsigned int
+anim_fx_stars_sparkle(struct anim_fx_ctx *ctx, bool first, void **pnext_fx)
+{
+    struct anim_fx_stars_sparkle_state *state = ctx->state;
+
+    if (first) {
+        state = anim_fx_ctx_start(ctx, sizeof(*state));
+        if (state == NULL) {
+            return anim_fx_exhausted(pnext_fx);
+        }
+        state->steps = 0;
+        return anim_fx_stars_sparkle_wait(ctx);
     }
 
-    if (anim_fx_script_step(&script, &delay)) {
-        *pnext_fx = anim_fx_balls_random;
+    /* Fade the sparkle out, leaving the layer transparent in the end */
+    if (state->steps > 0) {
+        state->steps--;
+        anim_layer_set(ctx->layer, ctx->led_list[state->idx],
+                       LEDS_BR_MAX * state->steps /
+                       ANIM_FX_STARS_SPARKLE_STEPS);
+        return state->steps > 0 ? ANIM_MS(40)
+                                : anim_fx_stars_sparkle_wait(ctx);
     }
-    return delay;
+
+    /* Light up a random star */
+    state->idx = rng_next(&ctx->rng, ctx->led_num);
+    state->steps = ANIM_FX_STARS_SPARKLE_STEPS;
+    anim_layer_set(ctx->layer, ctx->led_list[state->idx], LEDS_BR_MAX);
+    return ANIM_MS(40);
 }
 
+/** State of anim_fx_topper_fade_in() */
+struct anim_fx_topper_fade_in_state {
+    uint8_t step;
+};
+
+/**
+ * Delay of each anim_fx_topper_fade_in() step, ticks: the whole number of
+ * PWM cycles closest to a second of fade-in overall, so each brightness
+ * level is output for the same number of cycles.
+ */
+#define ANIM_FX_TOPPER_FADE_IN_DELAY \
+    (MAX((ANIM_MS(1000) / LEDS_BR_NUM + ANIM_CYCLE_TICKS / 2) /         \
+         ANIM_CYCLE_TICKS, 1) * ANIM_CYCLE_TICKS)
+
 unsigned int
-anim_fx_topper_fade_in(bool first, void **pnext_fx)
+anim_fx_topper_fade_in(struct anim_fx_ctx *ctx, bool first, void **pnext_fx)
 {
-    static uint8_t step;
+    struct anim_fx_topper_fade_in_state *state = ctx->state;
     size_t i;
 
     if (first) {
-        step = 0;
+        state = anim_fx_ctx_start(ctx, sizeof(*state));
+        if (state == NULL) {
+            return anim_fx_exhausted(pnext_fx);
+        }
+        state->step = 0;
     }
 
-    for (i = 0; i < ARRAY_SIZE(LEDS_TOPPER_LIST); i++) {
-        LEDS_BR[LEDS_TOPPER_LIST[i]] = step;
+    for (i = 0; i < ctx->led_num; i++) {
+        anim_layer_set(ctx->layer, ctx->led_list[i], state->step);
     }
-    step++;
+    state->step++;
 
-    if (step == LEDS_BR_MAX) {
+    if (state->step == LEDS_BR_MAX) {
         *pnext_fx = anim_fx_stop;
     }
 
-    return 1000 / LEDS_BR_NUM;
+    return ANIM_FX_TOPPER_FADE_IN_DELAY;
 }
 
-unsigned int
-anim_fx_balls_fade_in_and_out(bool first, void **pnext_fx)
-{
-    static enum {
+/** State of anim_fx_balls_fade_in_and_out() */
+struct anim_fx_balls_fade_in_and_out_state {
+    enum {
         FADE_IN,
         WAIT,
         FADE_OUT
     } stage;
-    static int step;
+    int step;
+};
+
+unsigned int
+anim_fx_balls_fade_in_and_out(struct anim_fx_ctx *ctx,
+                              bool first, void **pnext_fx)
+{
+    struct anim_fx_balls_fade_in_and_out_state *state = ctx->state;
     static const uint8_t br_steps[] = {
         0,
         LEDS_BR_MAX / 4,
@@ -113,13 +333,17 @@ anim_fx_balls_fade_in_and_out(bool first, void **pnext_fx)
     int j;
 
     if (first) {
-        stage = FADE_IN;
-        step = 0;
+        state = anim_fx_ctx_start(ctx, sizeof(*state));
+        if (state == NULL) {
+            return anim_fx_exhausted(pnext_fx);
+        }
+        state->stage = FADE_IN;
+        state->step = 0;
     }
 
-    if (stage == WAIT) {
-        stage = FADE_OUT;
-        return 10000;
+    if (state->stage == WAIT) {
+        state->stage = FADE_OUT;
+        return ANIM_MS(10000);
     }
 
     idx = 0;
@@ -128,35 +352,42 @@ anim_fx_balls_fade_in_and_out(bool first, void **pnext_fx)
              j < (int)ARRAY_SIZE(LEDS_BALLS_SWNE_LINE_LIST[i]) &&
              LEDS_BALLS_SWNE_LINE_LIST[i][j] != LEDS_IDX_INVALID;
              j++) {
-            br_idx = step - idx;
+            br_idx = state->step - idx;
             if (br_idx < 0) {
                 br_idx = 0;
             } else if (br_idx >= (int)ARRAY_SIZE(br_steps)) {
                 br_idx = ARRAY_SIZE(br_steps) - 1;
             }
-            LEDS_BR[LEDS_BALLS_SWNE_LINE_LIST[i][j]] = br_steps[br_idx];
+            anim_layer_set(ctx->layer, LEDS_BALLS_SWNE_LINE_LIST[i][j],
+                           br_steps[br_idx]);
             idx++;
         }
     }
 
-    if (stage == FADE_IN) {
-        step++;
-        if (step == LEDS_BALLS_NUM + ARRAY_SIZE(br_steps) - 1) {
-            stage = WAIT;
+    if (state->stage == FADE_IN) {
+        state->step++;
+        if (state->step == LEDS_BALLS_NUM + ARRAY_SIZE(br_steps) - 1) {
+            state->stage = WAIT;
         }
-    } else if (stage == FADE_OUT) {
-        step--;
-        if (step == 0) {
+    } else if (state->stage == FADE_OUT) {
+        state->step--;
+        if (state->step == 0) {
             *pnext_fx = anim_fx_balls_random;
         }
     }
 
-    return 1500 / (LEDS_BALLS_NUM + ARRAY_SIZE(br_steps) - 1);
+    return ANIM_MS(1500) / (LEDS_BALLS_NUM + ARRAY_SIZE(br_steps) - 1);
 }
 
+/** State of anim_fx_balls_wave() */
+struct anim_fx_balls_wave_state {
+    size_t step;
+};
+
 unsigned int
-anim_fx_balls_wave(bool first, void **pnext_fx)
+anim_fx_balls_wave(struct anim_fx_ctx *ctx, bool first, void **pnext_fx)
 {
+    struct anim_fx_balls_wave_state *state = ctx->state;
     /*
      * Generated with
      * perl -e 'use Math::Trig;
@@ -172,19 +403,22 @@ anim_fx_balls_wave(bool first, void **pnext_fx)
         63, 63, 63, 62, 62, 61, 60, 59, 58, 57, 56, 55, 53, 52, 50, 49,
         47, 45, 44, 42, 41, 39, 38, 37, 36, 35, 34, 33, 32, 32, 31, 31,
     };
-    static size_t step;
     size_t i, j, k, w;
     unsigned int br;
 
     if (first) {
-        step = 0;
+        state = anim_fx_ctx_start(ctx, sizeof(*state));
+        if (state == NULL) {
+            return anim_fx_exhausted(pnext_fx);
+        }
+        state->step = 0;
     }
 
     /* For each line of balls */
     for (i = 0; i < ARRAY_SIZE(LEDS_BALLS_SWNE_LINE_LIST); i++) {
-        w = step + (i << 2);
+        w = state->step + (i << 2);
         /* Calculate brightness */
-        br = wave[w & (ARRAY_SIZE(wave) - 1)];
+        br = LEDS_BR_FROM_64(wave[w & (ARRAY_SIZE(wave) - 1)]);
         /* If fading in */
         if ((w & 0x700) == 0) {
             br = (br * ((w >> 2) & 0x3f)) >> 6;
@@ -196,134 +430,135 @@ anim_fx_balls_wave(bool first, void **pnext_fx)
         for (j = 0;
              (k = LEDS_BALLS_SWNE_LINE_LIST[i][j]) != LEDS_IDX_INVALID;
              j++) {
-            LEDS_BR[k] = br;
+            anim_layer_set(ctx->layer, k, br);
         }
     }
 
-    step++;
+    state->step++;
 
-    if (step == 0x800) {
+    if (state->step == 0x800) {
         *pnext_fx = anim_fx_balls_random;
     }
 
-    return 50;
+    return ANIM_MS(50);
 }
 
+/** Segments of anim_fx_balls_glitter() */
+static const struct anim_fx_script_seg ANIM_FX_BALLS_GLITTER_SEG_LIST[] = {
+    {.step_num_min = 1,
+     .step_num_max = 1,
+     .step_br_off = LEDS_BR_MAX,
+     /* FIXME Setting this to zero crashes the program eventually */
+     .step_delay_min = ANIM_MS(10),
+     .step_delay_max = ANIM_MS(300)},
+    {.step_num_min = 1,
+     .step_num_max = 1,
+     .step_br_off = -LEDS_BR_MAX,
+     .step_delay_min = ANIM_MS(10),
+     .step_delay_max = ANIM_MS(10)},
+};
+
 unsigned int
-anim_fx_balls_glitter(bool first, void **pnext_fx)
+anim_fx_balls_glitter(struct anim_fx_ctx *ctx, bool first, void **pnext_fx)
 {
-    static struct anim_fx_script script;
-    static const struct anim_fx_script_seg seg_list[] = {
-        {.step_num_min = 1,
-         .step_num_max = 1,
-         .step_br_off = LEDS_BR_MAX,
-         /* FIXME Setting this to zero crashes the program eventually */
-         .step_delay_min = 10,
-         .step_delay_max = 300},
-        {.step_num_min = 1,
-         .step_num_max = 1,
-         .step_br_off = -LEDS_BR_MAX,
-         .step_delay_min = 10,
-         .step_delay_max = 10},
-    };
-    static struct anim_fx_script_led led_list[LEDS_BALLS_NUM];
-    static struct anim_fx_script_led_seg
-                            led_seg_list_list[LEDS_BALLS_NUM *
-                                              ARRAY_SIZE(seg_list)];
-    unsigned int delay;
-
-    if (first) {
-        anim_fx_script_init(
-                    &script, ARRAY_SIZE(seg_list), seg_list,
-                    LEDS_BALLS_NUM, LEDS_BALLS_LIST,
-                    led_list, led_seg_list_list,
+    return anim_fx_script_run(
+                    ctx, first, pnext_fx,
+                    ARRAY_SIZE(ANIM_FX_BALLS_GLITTER_SEG_LIST),
+                    ANIM_FX_BALLS_GLITTER_SEG_LIST,
                     /* Initial brightness */
                     0,
-                    /* Fade-in/out duration, ms */
-                    3000,
-                    /* Effect body duration, ms */
-                    60000);
-    }
-
-    if (anim_fx_script_step(&script, &delay)) {
-        *pnext_fx = anim_fx_balls_random;
-    }
-    return delay;
+                    /* Fade-in/out duration, ticks */
+                    ANIM_MS(3000),
+                    /* Effect body duration, ticks */
+                    ANIM_MS(60000));
 }
 
+/** State of anim_fx_balls_cycle_colors() */
+struct anim_fx_balls_cycle_colors_state {
+    unsigned int step;
+    enum leds_balls_color prev_color;
+    enum leds_balls_color cur_color;
+    unsigned int hue;
+};
+
 unsigned int
-anim_fx_balls_cycle_colors(bool first, void **pnext_fx)
+anim_fx_balls_cycle_colors(struct anim_fx_ctx *ctx,
+                           bool first, void **pnext_fx)
 {
-    static unsigned int step;
-    static enum leds_balls_color prev_color;
-    static enum leds_balls_color cur_color;
-    static unsigned int hue;
+    struct anim_fx_balls_cycle_colors_state *state = ctx->state;
     enum leds_balls_color color;
     uint8_t br;
     size_t i;
 
-    (void)pnext_fx;
-
     if (first) {
-        step = 0;
-        prev_color = LEDS_BALLS_COLOR_NUM;
-        cur_color = 0;
-        hue = 0;
+        state = anim_fx_ctx_start(ctx, sizeof(*state));
+        if (state == NULL) {
+            return anim_fx_exhausted(pnext_fx);
+        }
+        state->step = 0;
+        state->prev_color = LEDS_BALLS_COLOR_NUM;
+        state->cur_color = 0;
+        state->hue = 0;
     }
 
-    if (step == 12) {
-        cur_color = LEDS_BALLS_COLOR_NUM;
+    if (state->step == 12) {
+        state->cur_color = LEDS_BALLS_COLOR_NUM;
     }
 
     for (color = 0; color < ARRAY_SIZE(LEDS_BALLS_COLOR_LIST); color++) {
-        if (color == cur_color) {
-            br = ((hue + 1) * LEDS_BR_MAX) >> 3 ;
-        } else if (color == prev_color) {
-            br = ((7 - hue) * LEDS_BR_MAX) >> 3;
+        if (color == state->cur_color) {
+            br = ((state->hue + 1) * LEDS_BR_MAX) >> 3 ;
+        } else if (color == state->prev_color) {
+            br = ((7 - state->hue) * LEDS_BR_MAX) >> 3;
         } else {
             br = 0;
         }
         for (i = 0; i < ARRAY_SIZE(LEDS_BALLS_COLOR_LIST[color]); i++) {
-            LEDS_BR[LEDS_BALLS_COLOR_LIST[color][i]] = br;
+            anim_layer_set(ctx->layer, LEDS_BALLS_COLOR_LIST[color][i], br);
         }
     }
 
-    hue++;
-    if (hue >= 8) {
-        hue = 0;
-        prev_color = cur_color;
-        cur_color++;
-        if (cur_color >= LEDS_BALLS_COLOR_NUM) {
-            cur_color = 0;
-            step++;
-            if (step > 12) {
+    state->hue++;
+    if (state->hue >= 8) {
+        state->hue = 0;
+        state->prev_color = state->cur_color;
+        state->cur_color++;
+        if (state->cur_color >= LEDS_BALLS_COLOR_NUM) {
+            state->cur_color = 0;
+            state->step++;
+            if (state->step > 12) {
                 *pnext_fx = anim_fx_balls_random;
             }
         }
     }
 
-    return hue == 1 ? 1100 : 50;
+    return state->hue == 1 ? ANIM_MS(1100) : ANIM_MS(50);
 }
 
-unsigned int
-anim_fx_balls_snow(bool first, void **pnext_fx)
-{
+/** State of anim_fx_balls_snow() */
+struct anim_fx_balls_snow_state {
     /* True if filling, false if emptying */
-    static bool fill;
+    bool fill;
     /* The current row being filled/emtpied, destination/origin row */
-    static uint8_t row;
+    uint8_t row;
     /* Current row column status */
-    static bool idle_cols[LEDS_BALLS_COL_NUM];
+    bool idle_cols[LEDS_BALLS_COL_NUM];
     /* Number of unfilled/unemptied columns at the current row */
-    static uint8_t idle_cols_num;
+    uint8_t idle_cols_num;
     /* Current falling ball column */
-    static uint8_t ball_col;
+    uint8_t ball_col;
     /* Previous falling ball row */
-    static uint8_t prev_ball_row;
+    uint8_t prev_ball_row;
     /* Current falling ball row */
-    static uint8_t ball_row;
+    uint8_t ball_row;
     /* Ball brightness */
-    static uint8_t ball_br;
+    uint16_t ball_br;
+};
+
+unsigned int
+anim_fx_balls_snow(struct anim_fx_ctx *ctx, bool first, void **pnext_fx)
+{
+    struct anim_fx_balls_snow_state *state = ctx->state;
 
     /* True if we're scheduling lighting the next ball */
     bool moving;
@@ -331,62 +566,68 @@ anim_fx_balls_snow(bool first, void **pnext_fx)
     size_t i;
 
     if (first) {
+        state = anim_fx_ctx_start(ctx, sizeof(*state));
+        if (state == NULL) {
+            return anim_fx_exhausted(pnext_fx);
+        }
         /* We're filling */
-        fill = true;
+        state->fill = true;
         /* Below the bottom row */
-        row = LEDS_BALLS_ROW_NUM;
+        state->row = LEDS_BALLS_ROW_NUM;
         /* No unfilled columns remaining in the row */
-        idle_cols_num = 0;
+        state->idle_cols_num = 0;
         /* Ball in the below-the-bottom row */
-        ball_row = row;
+        state->ball_row = state->row;
         /* Ball finished lighting */
-        ball_br = LEDS_BR_MAX;
+        state->ball_br = LEDS_BR_MAX;
     }
 
     /* Else, if the ball in current position is lighted fully */
-    if (ball_br >= LEDS_BR_MAX) {
+    if (state->ball_br >= LEDS_BR_MAX) {
         /* Reset ball brightness */
-        ball_br = 0;
+        state->ball_br = 0;
         /* Current row becomes previous row */
-        prev_ball_row = ball_row;
+        state->prev_ball_row = state->ball_row;
 
         /* If the ball is in flight still */
-        if (fill ? (ball_row < row) : (ball_row <= LEDS_BALLS_ROW_NUM)) {
+        if (state->fill ? (state->ball_row < state->row)
+                        : (state->ball_row <= LEDS_BALLS_ROW_NUM)) {
             /* Move to the next row */
-            ball_row++;
+            state->ball_row++;
         /* Else */
         } else {
             /* If there are no unfilled columns left */
-            if (idle_cols_num == 0) {
+            if (state->idle_cols_num == 0) {
                 /* If we are at the top */
-                if (row == 0) {
-                    if (fill) {
+                if (state->row == 0) {
+                    if (state->fill) {
                         /* Switch to emptying */
-                        fill = false;
+                        state->fill = false;
                         /* Emptying row below the bottom */
-                        row = LEDS_BALLS_ROW_NUM + 1;
+                        state->row = LEDS_BALLS_ROW_NUM + 1;
                         /* No unemptied columns left */
-                        idle_cols_num = 0;
+                        state->idle_cols_num = 0;
                         /* Ball is below the bottom */
-                        ball_row = row;
+                        state->ball_row = state->row;
                         /* Completely lighted */
-                        ball_br = LEDS_BR_MAX;
+                        state->ball_br = LEDS_BR_MAX;
                         /* Wait before emptying */
-                        return 7000;
+                        return ANIM_MS(7000);
                     } else {
                         /* Run random effects forever */
                         *pnext_fx = anim_fx_balls_random;
                         /* Wait to allow satisfaction settle a little */
-                        return 3000;
+                        return ANIM_MS(3000);
                     }
                 }
                 /* Move up a row */
-                row--;
+                state->row--;
                 /* Count and mark available columns */
                 for (i = 0; i < LEDS_BALLS_COL_NUM; i++) {
-                    idle_cols[i] = LEDS_BALLS_ROW_LIST[row][i] != LEDS_IDX_INVALID;
-                    if (idle_cols[i]) {
-                        idle_cols_num++;
+                    state->idle_cols[i] =
+                        LEDS_BALLS_ROW_LIST[state->row][i] != LEDS_IDX_INVALID;
+                    if (state->idle_cols[i]) {
+                        state->idle_cols_num++;
                     }
                 }
             }
@@ -394,9 +635,11 @@ anim_fx_balls_snow(bool first, void **pnext_fx)
              * At the current fill/emptying row,
              * choose a column from unfilled/unemptied
              */
-            i = ((prng_next() & 0xffff) * (uint32_t)idle_cols_num) >> 16;
-            for (ball_col = 0; ball_col < LEDS_BALLS_COL_NUM; ball_col++) {
-                if (idle_cols[ball_col]) {
+            i = rng_next(&ctx->rng, state->idle_cols_num);
+            for (state->ball_col = 0;
+                 state->ball_col < LEDS_BALLS_COL_NUM;
+                 state->ball_col++) {
+                if (state->idle_cols[state->ball_col]) {
                     if (i == 0) {
                         break;
                     } else {
@@ -404,41 +647,47 @@ anim_fx_balls_snow(bool first, void **pnext_fx)
                     }
                 }
             }
-            idle_cols[ball_col] = false;
-            idle_cols_num--;
-            if (fill) {
-                ball_row = 0;
+            state->idle_cols[state->ball_col] = false;
+            state->idle_cols_num--;
+            if (state->fill) {
+                state->ball_row = 0;
             } else {
-                prev_ball_row = row;
-                ball_row = row + 1;
+                state->prev_ball_row = state->row;
+                state->ball_row = state->row + 1;
             }
         }
 
         /* Find the row where column is present */
-        for (; (fill ? (ball_row < row) : (ball_row < LEDS_BALLS_ROW_NUM)) &&
-               LEDS_BALLS_ROW_LIST[ball_row][ball_col] == LEDS_IDX_INVALID;
-             ball_row++);
+        for (; (state->fill ? (state->ball_row < state->row)
+                            : (state->ball_row < LEDS_BALLS_ROW_NUM)) &&
+               LEDS_BALLS_ROW_LIST[state->ball_row][state->ball_col] ==
+                    LEDS_IDX_INVALID;
+             state->ball_row++);
     }
 
     /* Check if we're starting the new position */
-    moving = (ball_br == 0);
+    moving = (state->ball_br == 0);
 
     /* Increase ball brightness */
-    ball_br += LEDS_BR_NUM / 8;
-    if (ball_br > LEDS_BR_MAX) {
-        ball_br = LEDS_BR_MAX;
+    state->ball_br += LEDS_BR_NUM / 8;
+    if (state->ball_br > LEDS_BR_MAX) {
+        state->ball_br = LEDS_BR_MAX;
     }
 
     /* Update brightness of the previous ball, if any */
-    if (fill ? (prev_ball_row < ball_row)
-             : (prev_ball_row < LEDS_BALLS_ROW_NUM)) {
-        LEDS_BR[LEDS_BALLS_ROW_LIST[prev_ball_row][ball_col]] =
-            LEDS_BR_MAX - ball_br;
+    if (state->fill ? (state->prev_ball_row < state->ball_row)
+                    : (state->prev_ball_row < LEDS_BALLS_ROW_NUM)) {
+        anim_layer_set(ctx->layer,
+                       LEDS_BALLS_ROW_LIST[state->prev_ball_row]
+                                          [state->ball_col],
+                       LEDS_BR_MAX - state->ball_br);
     }
 
     /* Update brightness of the current ball, if any */
-    if (ball_row < LEDS_BALLS_ROW_NUM) {
-        LEDS_BR[LEDS_BALLS_ROW_LIST[ball_row][ball_col]] = ball_br;
+    if (state->ball_row < LEDS_BALLS_ROW_NUM) {
+        anim_layer_set(ctx->layer,
+                       LEDS_BALLS_ROW_LIST[state->ball_row][state->ball_col],
+                       state->ball_br);
     }
 
     /*
@@ -446,161 +695,148 @@ anim_fx_balls_snow(bool first, void **pnext_fx)
      * Wait longer before lighting the next ball so fully-lighted ball would
      * stay bright longer.
      */
-    return moving ? 250 : 75;
+    return moving ? ANIM_MS(250) : ANIM_MS(75);
 }
 
+/** Segments of anim_fx_balls_shimmer() */
+static const struct anim_fx_script_seg ANIM_FX_BALLS_SHIMMER_SEG_LIST[] = {
+    {.step_num_min = 1,
+     .step_num_max = 1,
+     .step_br_off = 0,
+     .step_delay_min = ANIM_MS(0),
+     .step_delay_max = ANIM_MS(3000)},
+    {.step_num_min = 5,
+     .step_num_max = 5,
+     .step_br_off = LEDS_BR_FROM_64(-2),
+     .step_delay_min = ANIM_MS(56),
+     .step_delay_max = ANIM_MS(56)},
+    {.step_num_min = 1,
+     .step_num_max = 1,
+     .step_br_off = 0,
+     .step_delay_min = ANIM_MS(300),
+     .step_delay_max = ANIM_MS(600)},
+    {.step_num_min = 5,
+     .step_num_max = 5,
+     .step_br_off = LEDS_BR_FROM_64(2),
+     .step_delay_min = ANIM_MS(56),
+     .step_delay_max = ANIM_MS(56)}
+};
+
 unsigned int
-anim_fx_balls_shimmer(bool first, void **pnext_fx)
+anim_fx_balls_shimmer(struct anim_fx_ctx *ctx, bool first, void **pnext_fx)
 {
-    static struct anim_fx_script script;
-    static const struct anim_fx_script_seg seg_list[] = {
-        {.step_num_min = 1,
-         .step_num_max = 1,
-         .step_br_off = 0,
-         .step_delay_min = 0,
-         .step_delay_max = 3000},
-        {.step_num_min = 5,
-         .step_num_max = 5,
-         .step_br_off = -2,
-         .step_delay_min = 56,
-         .step_delay_max = 56},
-        {.step_num_min = 1,
-         .step_num_max = 1,
-         .step_br_off = 0,
-         .step_delay_min = 300,
-         .step_delay_max = 600},
-        {.step_num_min = 5,
-         .step_num_max = 5,
-         .step_br_off = 2,
-         .step_delay_min = 56,
-         .step_delay_max = 56}
-    };
-    static struct anim_fx_script_led led_list[LEDS_BALLS_NUM];
-    static struct anim_fx_script_led_seg
-                            led_seg_list_list[LEDS_BALLS_NUM *
-                                              ARRAY_SIZE(seg_list)];
-    unsigned int delay;
-
-    if (first) {
-        anim_fx_script_init(
-                    &script, ARRAY_SIZE(seg_list), seg_list,
-                    LEDS_BALLS_NUM, LEDS_BALLS_LIST,
-                    led_list, led_seg_list_list,
+    return anim_fx_script_run(
+                    ctx, first, pnext_fx,
+                    ARRAY_SIZE(ANIM_FX_BALLS_SHIMMER_SEG_LIST),
+                    ANIM_FX_BALLS_SHIMMER_SEG_LIST,
                     /* Initial brightness */
                     LEDS_BR_MAX,
-                    /* Fade-in/out duration, ms */
-                    3000,
-                    /* Effect body duration, ms */
-                    60000);
-    }
-
-    if (anim_fx_script_step(&script, &delay)) {
-        *pnext_fx = anim_fx_balls_random;
-    }
-    return delay;
+                    /* Fade-in/out duration, ticks */
+                    ANIM_MS(3000),
+                    /* Effect body duration, ticks */
+                    ANIM_MS(60000));
 }
 
+/** Segments of anim_fx_balls_flare() */
+static const struct anim_fx_script_seg ANIM_FX_BALLS_FLARE_SEG_LIST[] = {
+    {.step_num_min = 1,
+     .step_num_max = 1,
+     .step_br_off = 0,
+     .step_delay_min = ANIM_MS(3000),
+     .step_delay_max = ANIM_MS(10000)},
+    {.step_num_min = 7,
+     .step_num_max = 7,
+     .step_br_off = LEDS_BR_FROM_64(9),
+     .step_delay_min = ANIM_MS(22),
+     .step_delay_max = ANIM_MS(22)},
+    {.step_num_min = 1,
+     .step_num_max = 1,
+     .step_br_off = 0,
+     .step_delay_min = ANIM_MS(500),
+     .step_delay_max = ANIM_MS(500)},
+    {.step_num_min = 21,
+     .step_num_max = 21,
+     .step_br_off = LEDS_BR_FROM_64(-3),
+     .step_delay_min = ANIM_MS(80),
+     .step_delay_max = ANIM_MS(80)}
+};
+
 unsigned int
-anim_fx_balls_flare(bool first, void **pnext_fx)
+anim_fx_balls_flare(struct anim_fx_ctx *ctx, bool first, void **pnext_fx)
 {
-    static struct anim_fx_script script;
-    static const struct anim_fx_script_seg seg_list[] = {
-        {.step_num_min = 1,
-         .step_num_max = 1,
-         .step_br_off = 0,
-         .step_delay_min = 3000,
-         .step_delay_max = 10000},
-        {.step_num_min = 7,
-         .step_num_max = 7,
-         .step_br_off = 9,
-         .step_delay_min = 22,
-         .step_delay_max = 22},
-        {.step_num_min = 1,
-         .step_num_max = 1,
-         .step_br_off = 0,
-         .step_delay_min = 500,
-         .step_delay_max = 500},
-        {.step_num_min = 21,
-         .step_num_max = 21,
-         .step_br_off = -3,
-         .step_delay_min = 80,
-         .step_delay_max = 80}
-    };
-    static struct anim_fx_script_led led_list[LEDS_BALLS_NUM];
-    static struct anim_fx_script_led_seg
-                            led_seg_list_list[LEDS_BALLS_NUM *
-                                              ARRAY_SIZE(seg_list)];
-    unsigned int delay;
-
-    if (first) {
-        anim_fx_script_init(
-                    &script, ARRAY_SIZE(seg_list), seg_list,
-                    LEDS_BALLS_NUM, LEDS_BALLS_LIST,
-                    led_list, led_seg_list_list,
+    return anim_fx_script_run(
+                    ctx, first, pnext_fx,
+                    ARRAY_SIZE(ANIM_FX_BALLS_FLARE_SEG_LIST),
+                    ANIM_FX_BALLS_FLARE_SEG_LIST,
                     /* Initial brightness */
                     0,
-                    /* Fade-in/out duration, ms */
-                    2000,
-                    /* Effect body duration, ms */
-                    60000);
-    }
-
-    if (anim_fx_script_step(&script, &delay)) {
-        *pnext_fx = anim_fx_balls_random;
-    }
-    return delay;
+                    /* Fade-in/out duration, ticks */
+                    ANIM_MS(2000),
+                    /* Effect body duration, ticks */
+                    ANIM_MS(60000));
 }
 
-unsigned int
-anim_fx_balls_shoot(bool first, void **pnext_fx)
-{
+/** State of anim_fx_balls_shoot() */
+struct anim_fx_balls_shoot_state {
     /* True if shooting balls "on", false if "off" */
-    static bool shooting_on;
+    bool shooting_on;
     /* Remaining number of balls to shoot */
-    static uint8_t remaining;
-    /* Index of the ball being shot */
-    static uint8_t idx;
+    uint8_t remaining;
+    /* Index of the ball being shot in the zone */
+    uint8_t idx;
     /* Brightness of the ball being shot */
-    static int8_t br;
+    int16_t br;
+};
+
+unsigned int
+anim_fx_balls_shoot(struct anim_fx_ctx *ctx, bool first, void **pnext_fx)
+{
+    struct anim_fx_balls_shoot_state *state = ctx->state;
     /* True if scheduling a new ball shot */
-    static bool new;
+    bool new;
 
     if (first) {
         size_t i;
-        shooting_on = true;
+        state = anim_fx_ctx_start(ctx, sizeof(*state));
+        if (state == NULL) {
+            return anim_fx_exhausted(pnext_fx);
+        }
+        state->shooting_on = true;
         /* We just shot a non-existing ball, pick another */
-        remaining = LEDS_BALLS_NUM;
-        idx = LEDS_BALLS_NUM;
-        br = LEDS_BR_MAX;
+        state->remaining = ctx->led_num;
+        state->idx = ctx->led_num;
+        state->br = LEDS_BR_MAX;
         /*
          * FIXME Clearing all LEDs to zero brightness, because some effects
          * (perhaps anim_fx_balls_wave) might leave them not completely dark,
          * breaking this effect. Fix other effects instead, and add
          * verification for darkness between effects.
          */
-        for (i = 0; i < LEDS_BALLS_NUM; i++) {
-            LEDS_BR[LEDS_BALLS_LIST[i]] = 0;
+        for (i = 0; i < ctx->led_num; i++) {
+            anim_layer_set(ctx->layer, ctx->led_list[i], 0);
         }
     }
 
     /* If we're still shooting the current ball */
-    if (shooting_on ? (br < LEDS_BR_MAX) : (br > 0)) {
-        br = shooting_on ? MIN(br + 8, LEDS_BR_MAX)
-                         : MAX(br - 8, 0);
+    if (state->shooting_on ? (state->br < LEDS_BR_MAX) : (state->br > 0)) {
+        state->br = state->shooting_on
+                        ? MIN(state->br + LEDS_BR_FROM_64(8), LEDS_BR_MAX)
+                        : MAX(state->br - LEDS_BR_FROM_64(8), 0);
         /* Continuing with a ball */
         new = false;
     /* Else, if there are balls left to shoot */
-    } else if (remaining > 0) {
+    } else if (state->remaining > 0) {
         size_t pos;
 
         /* Starting a new ball unless it's the first */
-        new = (remaining < LEDS_BALLS_NUM);
+        new = (state->remaining < ctx->led_num);
 
         /* Pick a new ball to shoot */
-        pos = ((prng_next() & 0xffff) * remaining) >> 16;
-        for (idx = 0; idx < LEDS_BALLS_NUM; idx++) {
-            if (LEDS_BR[LEDS_BALLS_LIST[idx]] ==
-                    (shooting_on ? 0 : LEDS_BR_MAX)) {
+        pos = rng_next(&ctx->rng, state->remaining);
+        for (state->idx = 0; state->idx < ctx->led_num; state->idx++) {
+            if (anim_layer_get(ctx->layer,
+                               ctx->led_list[state->idx]) ==
+                    (state->shooting_on ? 0 : LEDS_BR_MAX)) {
                 if (pos == 0) {
                     break;
                 } else {
@@ -608,32 +844,33 @@ anim_fx_balls_shoot(bool first, void **pnext_fx)
                 }
             }
         }
-        remaining--;
+        state->remaining--;
 
         /* Start changing brightness */
-        br = shooting_on ? 7 : (LEDS_BR_MAX - 7);
+        state->br = state->shooting_on ? LEDS_BR_FROM_64(7)
+                                       : LEDS_BR_MAX - LEDS_BR_FROM_64(7);
     /* Else, there are NO balls left to shoot */
     } else {
         /* If we were shooting on */
-        if (shooting_on) {
-            shooting_on = false;
+        if (state->shooting_on) {
+            state->shooting_on = false;
             /* We just shot a non-existing ball, pick another */
-            remaining = LEDS_BALLS_NUM;
-            idx = LEDS_BALLS_NUM;
-            br = 0;
+            state->remaining = ctx->led_num;
+            state->idx = ctx->led_num;
+            state->br = 0;
             /* Wait for satisfaction */
-            return 10000;
+            return ANIM_MS(10000);
         /* Else, we were shooting off */
         } else {
             *pnext_fx = anim_fx_balls_random;
             /* Wait for satisfaction */
-            return 3000;
+            return ANIM_MS(3000);
         }
     }
 
-    LEDS_BR[LEDS_BALLS_LIST[idx]] = br;
+    anim_layer_set(ctx->layer, ctx->led_list[state->idx], state->br);
     /* Delay before shooting a new ball */
-    return new ? 1000 : 75;
+    return new ? ANIM_MS(1000) : ANIM_MS(75);
 }
 
 /** Pool of the balls effect-stepping functions to choose from randomly */
@@ -648,24 +885,56 @@ static const anim_fx_fn ANIM_FX_BALLS_RANDOM_POOL[] = {
     anim_fx_balls_flare,
 };
 
-/** Index of the balls effect-stepping function chosen last */
-static size_t ANIM_FX_BALLS_RANDOM_LAST = 0;
-
 unsigned int
-anim_fx_balls_random(bool first, void **pnext_fx)
+anim_fx_balls_random(struct anim_fx_ctx *ctx, bool first, void **pnext_fx)
 {
     size_t i;
 
     (void)first;
-    (void)pnext_fx;
 
-    i = prng_next() % ARRAY_SIZE(ANIM_FX_BALLS_RANDOM_POOL);
-    if (i == ANIM_FX_BALLS_RANDOM_LAST) {
+    i = rng_next(&ctx->rng, ARRAY_SIZE(ANIM_FX_BALLS_RANDOM_POOL));
+    if (i == ctx->balls_random_last) {
         i = (i + 1) % ARRAY_SIZE(ANIM_FX_BALLS_RANDOM_POOL);
     }
 
     *pnext_fx = ANIM_FX_BALLS_RANDOM_POOL[i];
-    ANIM_FX_BALLS_RANDOM_LAST = i;
+    ctx->balls_random_last = i;
 
     return 0;
 }
+
+/** States of the stars effects */
+union anim_fx_stars_state {
+    uint8_t shimmer[ANIM_FX_SCRIPT_SIZE(
+                        LEDS_STARS_NUM,
+                        ARRAY_SIZE(ANIM_FX_STARS_SHIMMER_SEG_LIST))];
+};
+
+ANIM_FX_ARENA(ANIM_FX_STARS_ARENA, union anim_fx_stars_state);
+
+/* The only stars overlay effect */
+ANIM_FX_ARENA(ANIM_FX_STARS_SPARKLE_ARENA,
+              struct anim_fx_stars_sparkle_state);
+
+/* The only topper effect */
+ANIM_FX_ARENA(ANIM_FX_TOPPER_ARENA, struct anim_fx_topper_fade_in_state);
+
+/** States of the balls effects, the arena holds the largest */
+union anim_fx_balls_state {
+    struct anim_fx_balls_fade_in_and_out_state  fade_in_and_out;
+    struct anim_fx_balls_wave_state             wave;
+    struct anim_fx_balls_cycle_colors_state     cycle_colors;
+    struct anim_fx_balls_snow_state             snow;
+    struct anim_fx_balls_shoot_state            shoot;
+    uint8_t glitter[ANIM_FX_SCRIPT_SIZE(
+                        LEDS_BALLS_NUM,
+                        ARRAY_SIZE(ANIM_FX_BALLS_GLITTER_SEG_LIST))];
+    uint8_t shimmer[ANIM_FX_SCRIPT_SIZE(
+                        LEDS_BALLS_NUM,
+                        ARRAY_SIZE(ANIM_FX_BALLS_SHIMMER_SEG_LIST))];
+    uint8_t flare[ANIM_FX_SCRIPT_SIZE(
+                        LEDS_BALLS_NUM,
+                        ARRAY_SIZE(ANIM_FX_BALLS_FLARE_SEG_LIST))];
+};
+
+ANIM_FX_ARENA(ANIM_FX_BALLS_ARENA, union anim_fx_balls_state);
@@ -5,62 +5,137 @@
 #ifndef _ANIM_FX_H
 #define _ANIM_FX_H
 
+#include "anim.h"
+#include "leds.h"
+#include "anim_layer.h"
+#include "rng.h"
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
+/** Bump-allocated arena for effect state */
+struct anim_fx_arena {
+    /** Size of the arena, bytes */
+    size_t      size;
+    /** Number of bytes allocated */
+    size_t      used;
+    /** Storage for the arena [size] */
+    uint8_t    *buf;
+};
+
+/**
+ * Context of the effects running in an animation thread: the LED zone to
+ * animate, and the state of the current effect.
+ */
+struct anim_fx_ctx {
+    /** Array of indexes of LEDs in the zone */
+    const leds_idx         *led_list;
+    /** Number of indexes of LEDs in led_list */
+    uint8_t                 led_num;
+    /** Layer to draw the zone's LEDs into */
+    struct anim_layer      *layer;
+    /** Arena to allocate the effect state from */
+    struct anim_fx_arena   *arena;
+    /** The effect state, allocated from the arena */
+    void                   *state;
+    /** Index of the balls effect chosen last by anim_fx_balls_random() */
+    uint8_t                 balls_random_last;
+    /** Random number stream of the thread */
+    struct rng              rng;
+};
+
 /**
  * Prototype for an effect-stepping function.
  *
- * Note that any effect-stepping function using static variables to keep
- * state makes the effect non-reentrant, and cannot be used in more than one
- * thread.
+ * The effect resets the context's arena and allocates its state from it
+ * on the first step, so effects running one after another in a thread
+ * share the memory, and effects running in different threads don't. If
+ * the arena is too small, the effect stops. Effects animate the LEDs in
+ * the context's zone, except the ones relying on the ball layout, which
+ * animate the balls.
  *
+ * @param ctx   The context of the thread running the effect.
  * @param first True if this is the function invocation for the first step.
  * @param pnext Location of the pointer to this function, and for the pointer
  *              to the next effect-stepping function to call, after the
  *              returned delay elapsed.
  *
  * @return The delay after which the function pointed to by pnext will be
- *         called.
+ *         called, in animation ticks. Effects timed in milliseconds
+ *         convert them with ANIM_MS().
  */
-typedef unsigned int (*anim_fx_fn)(bool first, void **pnext);
+typedef unsigned int (*anim_fx_fn)(struct anim_fx_ctx *ctx,
+                                   bool first, void **pnext);
+
+/** State arena for the stars effects */
+extern struct anim_fx_arena ANIM_FX_STARS_ARENA;
+
+/** State arena for the stars overlay effects */
+extern struct anim_fx_arena ANIM_FX_STARS_SPARKLE_ARENA;
+
+/** State arena for the topper effects */
+extern struct anim_fx_arena ANIM_FX_TOPPER_ARENA;
+
+/** State arena for the balls effects */
+extern struct anim_fx_arena ANIM_FX_BALLS_ARENA;
 
 /** Stop animation forever */
-extern unsigned int anim_fx_stop(bool first, void **pnext_fx);
+extern unsigned int anim_fx_stop(struct anim_fx_ctx *ctx,
+                                 bool first, void **pnext_fx);
 
 /** Shimmer stars forever */
-extern unsigned int anim_fx_stars_shimmer(bool first, void **pnext_fx);
+extern unsigned int anim_fx_stars_shimmer(struct anim_fx_ctx *ctx,
+                                          bool first, void **pnext_fx);
+
+/**
+ * Sparkle a random star every few seconds, fading it out from max
+ * brightness, forever. Meant to be blended over the stars with
+ * ANIM_LAYER_BLEND_MAX, leaving the layer transparent between sparkles.
+ */
+extern unsigned int anim_fx_stars_sparkle(struct anim_fx_ctx *ctx,
+                                          bool first, void **pnext_fx);
 
 /** Fade in the topper to max brightness, then stop */
-extern unsigned int anim_fx_topper_fade_in(bool first, void **pnext_fx);
+extern unsigned int anim_fx_topper_fade_in(struct anim_fx_ctx *ctx,
+                                           bool first, void **pnext_fx);
 
 /**
  * Fade in the balls over 1.5s, wait 10 seconds, then fade out over 1.5s,
  * and run random balls effects forever.
  */
-extern unsigned int anim_fx_balls_fade_in_and_out(bool first, void **pnext_fx);
+extern unsigned int anim_fx_balls_fade_in_and_out(struct anim_fx_ctx *ctx,
+                                                  bool first, void **pnext_fx);
 
 /** Send waves through the balls, then run random balls effects forever */
-extern unsigned int anim_fx_balls_wave(bool first, void **pnext_fx);
+extern unsigned int anim_fx_balls_wave(struct anim_fx_ctx *ctx,
+                                       bool first, void **pnext_fx);
 
 /** Glitter the balls, then run random balls effects forever */
-extern unsigned int anim_fx_balls_glitter(bool first, void **pnext_fx);
+extern unsigned int anim_fx_balls_glitter(struct anim_fx_ctx *ctx,
+                                          bool first, void **pnext_fx);
 
 /** Cycle ball colors, then run random balls effects forever */
-extern unsigned int anim_fx_balls_cycle_colors(bool first, void **pnext_fx);
+extern unsigned int anim_fx_balls_cycle_colors(struct anim_fx_ctx *ctx,
+                                               bool first, void **pnext_fx);
 
 /** Snow balls, then run random balls effects forever */
-extern unsigned int anim_fx_balls_snow(bool first, void **pnext_fx);
+extern unsigned int anim_fx_balls_snow(struct anim_fx_ctx *ctx,
+                                       bool first, void **pnext_fx);
 
 /** Shimmer the balls, then run random balls effects forever */
-extern unsigned int anim_fx_balls_shimmer(bool first, void **pnext_fx);
+extern unsigned int anim_fx_balls_shimmer(struct anim_fx_ctx *ctx,
+                                          bool first, void **pnext_fx);
 
 /** Shoot the balls onto and off the tree, run random effects forever */
-extern unsigned int anim_fx_balls_shoot(bool first, void **pnext_fx);
+extern unsigned int anim_fx_balls_shoot(struct anim_fx_ctx *ctx,
+                                        bool first, void **pnext_fx);
 
 /** Run random balls effects forever */
-extern unsigned int anim_fx_balls_random(bool first, void **pnext_fx);
+extern unsigned int anim_fx_balls_random(struct anim_fx_ctx *ctx,
+                                         bool first, void **pnext_fx);
 
 /** Flare the balls on and slowly off, run random effects forever */
-extern unsigned int anim_fx_balls_flare(bool first, void **pnext_fx);
+extern unsigned int anim_fx_balls_flare(struct anim_fx_ctx *ctx,
+                                        bool first, void **pnext_fx);
 
 #endif /* _ANIM_FX_H */
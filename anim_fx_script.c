@@ -4,25 +4,31 @@
 
 #include "anim_fx_script.h"
 #include "leds.h"
-#include <prng.h>
 #include <misc.h>
 #include <limits.h>
 
+/**
+ * Number of segments to get random numbers for at once, when initializing
+ * a per-LED segment state list.
+ */
+#define ANIM_FX_SCRIPT_RNG_SEG_NUM  8
+
 /**
  * Initialize a per-LED segment state.
  *
  * @param seg       The segment description to initialize for.
  * @param led_seg   The per-LED segment state to initialize.
+ * @param rnd       Two random numbers to vary the state with.
  */
 void
 anim_fx_script_led_seg_init(const struct anim_fx_script_seg *seg,
-                            struct anim_fx_script_led_seg *led_seg)
+                            struct anim_fx_script_led_seg *led_seg,
+                            const uint32_t *rnd)
 {
-#define GEN_FIELD(_field) \
+#define GEN_FIELD(_field, _rnd) \
     do {                                                                \
         unsigned int min;                                               \
         unsigned int max;                                               \
-        unsigned int num;                                               \
                                                                         \
         if (seg->_field##_min <= seg->_field##_max) {                   \
             min = seg->_field##_min;                                    \
@@ -31,15 +37,12 @@ anim_fx_script_led_seg_init(const struct anim_fx_script_seg *seg,
             max = seg->_field##_min;                                    \
             min = seg->_field##_max;                                    \
         }                                                               \
-        led_seg->_field = min;                                          \
-        num = max - min;                                                \
-        if (num > 0) {                                                  \
-            led_seg->_field += (((prng_next() & 0xffff) * num) >> 16);  \
-        }                                                               \
+        led_seg->_field = min + rng_scale(_rnd, max - min);             \
     } while (0)
 
-    GEN_FIELD(step_num);
-    GEN_FIELD(step_delay);
+    GEN_FIELD(step_num, rnd[0]);
+    GEN_FIELD(step_delay, rnd[1]);
+#undef GEN_FIELD
 }
 
 /**
@@ -48,30 +51,124 @@ anim_fx_script_led_seg_init(const struct anim_fx_script_seg *seg,
  * @param seg_list      The segment description list to initialize for.
  * @param led_seg_list  The per-LED segment state list to initialize.
  * @param seg_num       Number of segments.
+ * @param rng           Random number stream to vary the states with.
  */
 void
 anim_fx_script_led_seg_list_init(const struct anim_fx_script_seg *seg_list,
                                  struct anim_fx_script_led_seg *led_seg_list,
-                                 uint8_t seg_num)
+                                 uint8_t seg_num,
+                                 struct rng *rng)
 {
+    uint32_t rnd[ANIM_FX_SCRIPT_RNG_SEG_NUM * 2];
     uint8_t i;
+    uint8_t num;
 
     for (i = 0; i < seg_num; i++) {
-        anim_fx_script_led_seg_init(&seg_list[i], &led_seg_list[i]);
+        /* Get random numbers for the next batch of segments */
+        num = i % ANIM_FX_SCRIPT_RNG_SEG_NUM;
+        if (num == 0) {
+            rng_fill(rng, rnd,
+                     MIN(seg_num - i, ANIM_FX_SCRIPT_RNG_SEG_NUM) * 2, 0);
+        }
+        anim_fx_script_led_seg_init(&seg_list[i], &led_seg_list[i],
+                                    &rnd[num * 2]);
+    }
+}
+
+/**
+ * Check if an LED is due before another one. Deadlines are compared
+ * accounting for wraparound.
+ *
+ * @param script    The scripted animation state.
+ * @param a         Index of the LED to check.
+ * @param b         Index of the LED to compare to.
+ *
+ * @return True if LED a is due before LED b, false otherwise.
+ */
+static inline bool
+anim_fx_script_led_before(const struct anim_fx_script *script,
+                          uint8_t a, uint8_t b)
+{
+    unsigned int a_deadline = script->led_list[a].deadline;
+    unsigned int b_deadline = script->led_list[b].deadline;
+    return (int)(a_deadline - b_deadline) < 0 ||
+           (a_deadline == b_deadline && a < b);
+}
+
+/**
+ * Move the LED at the top of the heap down to its place, after its
+ * deadline was moved later.
+ *
+ * @param script    The scripted animation state.
+ */
+static void
+anim_fx_script_heap_sift(struct anim_fx_script *script)
+{
+    uint8_t *heap = script->led_heap;
+    uint8_t i = 0;
+    uint8_t child;
+    uint8_t idx;
+
+    while ((child = i * 2 + 1) < script->led_num) {
+        if (child + 1 < script->led_num &&
+            anim_fx_script_led_before(script, heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!anim_fx_script_led_before(script, heap[child], heap[i])) {
+            break;
+        }
+        idx = heap[i];
+        heap[i] = heap[child];
+        heap[child] = idx;
+        i = child;
     }
 }
 
+/**
+ * Switch the LEDs with the specified deadline, from a heap subtree, to
+ * their next brightness. Only the matching LEDs and their children are
+ * visited.
+ *
+ * @param script    The scripted animation state.
+ * @param i         Heap index of the subtree root.
+ * @param deadline  The deadline of the LEDs to switch.
+ * @param output    True if the brightness should be drawn into the layer.
+ */
+static void
+anim_fx_script_heap_switch(struct anim_fx_script *script, uint8_t i,
+                           unsigned int deadline, bool output)
+{
+    struct anim_fx_script_led *led;
+
+    if (i >= script->led_num) {
+        return;
+    }
+    led = &script->led_list[script->led_heap[i]];
+    if (led->deadline != deadline) {
+        return;
+    }
+    led->br = led->next_br;
+    if (output) {
+        anim_layer_set(script->layer, led->idx, led->br);
+    }
+    anim_fx_script_heap_switch(script, i * 2 + 1, deadline, output);
+    anim_fx_script_heap_switch(script, i * 2 + 2, deadline, output);
+}
+
 void
 anim_fx_script_init(struct anim_fx_script *script,
                     uint8_t seg_num,
                     const struct anim_fx_script_seg *seg_list,
                     uint8_t led_num,
-                    const uint8_t *idx_list,
+                    const leds_idx *idx_list,
                     struct anim_fx_script_led *led_list,
+                    uint8_t *led_heap,
                     struct anim_fx_script_led_seg *led_seg_list_list,
                     uint8_t br,
                     unsigned int fade_delay,
-                    unsigned int duration)
+                    unsigned int duration,
+                    struct rng *rng,
+                    struct anim_layer *layer)
 {
     size_t i;
 
@@ -85,12 +182,15 @@ anim_fx_script_init(struct anim_fx_script *script,
         led->seg_list = led_seg_list_list + (i * seg_num);
 
         /* Position at the end of the cycle */
-        led->seg_idx = script->seg_num - 1;
+        led->seg_idx = seg_num - 1;
         led->steps_left = 0;
-        led->delay_left = 0;
+        led->deadline = 0;
 
         /* Initialize brightness */
         led->br = br;
+
+        /* All LEDs are due at once, so they're in index order */
+        led_heap[i] = i;
     }
 
     /* Initialize script state */
@@ -99,6 +199,11 @@ anim_fx_script_init(struct anim_fx_script *script,
 
     script->led_num = led_num;
     script->led_list = led_list;
+    script->led_heap = led_heap;
+
+    script->rng = rng;
+
+    script->layer = layer;
 
     script->fade_step_num = LEDS_BR_NUM;
     script->fade_step_delay = fade_delay / script->fade_step_num;
@@ -108,6 +213,7 @@ anim_fx_script_init(struct anim_fx_script *script,
 
     script->duration = duration;
     script->delay = 0;
+    script->time = 0;
 }
 
 bool
@@ -116,6 +222,8 @@ anim_fx_script_step(struct anim_fx_script *script, unsigned int *pdelay)
     uint8_t i;
     struct anim_fx_script_led *led;
     unsigned int delay;
+    uint8_t br;
+    bool faded = script->fade_steps_left > 0;
 
     /* If fading in/out */
     if (script->fade_steps_left > 0) {
@@ -139,19 +247,16 @@ anim_fx_script_step(struct anim_fx_script *script, unsigned int *pdelay)
         }
     }
 
+    script->time += script->delay;
+
     /*
-     * Advance the state of every animated LED
+     * Advance the state of every LED due now, in index order,
      * and determine delay to next update
      */
-    delay = UINT_MAX;
-    for (i = 0; i < script->led_num; i++) {
-        led = &script->led_list[i];
-
-        /* Subtract elapsed delay */
-        led->delay_left -= script->delay;
-
+    while ((led = &script->led_list[script->led_heap[0]])->deadline ==
+           script->time) {
         /* While the current step has no delay left */
-        while (led->delay_left == 0) {
+        while (led->deadline == script->time) {
             /* While the current seg has no steps left */
             while (led->steps_left == 0) {
                 /* If cycle is over */
@@ -159,7 +264,8 @@ anim_fx_script_step(struct anim_fx_script *script, unsigned int *pdelay)
                     /* Reinitialize segment states */
                     anim_fx_script_led_seg_list_init(script->seg_list,
                                                      led->seg_list,
-                                                     script->seg_num);
+                                                     script->seg_num,
+                                                     script->rng);
                     /* Restart */
                     led->seg_idx = 0;
                 } else {
@@ -169,15 +275,12 @@ anim_fx_script_step(struct anim_fx_script *script, unsigned int *pdelay)
                 led->steps_left = led->seg_list[led->seg_idx].step_num;
             }
             led->steps_left--;
-            led->delay_left = led->seg_list[led->seg_idx].step_delay;
+            led->deadline += led->seg_list[led->seg_idx].step_delay;
             led->next_br = led->br + script->seg_list[led->seg_idx].step_br_off;
         }
-
-        /* Determine delay to next update */
-        if (led->delay_left < delay) {
-            delay = led->delay_left;
-        }
+        anim_fx_script_heap_sift(script);
     }
+    delay = led->deadline - script->time;
 
     /* If fading-in/out */
     if (script->fade_steps_left > 0) {
@@ -190,29 +293,31 @@ anim_fx_script_step(struct anim_fx_script *script, unsigned int *pdelay)
     }
 
     /*
-     * Schedule LED updates
+     * Schedule LED updates, outputting only the changed LEDs,
+     * unless fading-in/out, or just finished
      */
-    for (i = 0; i < script->led_num; i++) {
-        led = &script->led_list[i];
-        /* If the LED is changing on the next step */
-        if (led->delay_left == delay) {
-            led->br = led->next_br;
-        }
-        /* If fading-in/out */
-        if (script->fade_steps_left > 0) {
-            /* If fading in */
-            if (script->duration > 0) {
-                LEDS_BR[led->idx] = (unsigned int)led->br *
-                                    (script->fade_step_num -
-                                     script->fade_steps_left + 1) /
-                                    script->fade_step_num;
+    anim_fx_script_heap_switch(script, 0, script->time + delay,
+                               script->fade_steps_left == 0);
+    if (script->fade_steps_left > 0 || faded) {
+        for (i = 0; i < script->led_num; i++) {
+            led = &script->led_list[i];
+            /* If fading-in/out */
+            if (script->fade_steps_left > 0) {
+                /* If fading in */
+                if (script->duration > 0) {
+                    br = (unsigned int)led->br *
+                         (script->fade_step_num -
+                          script->fade_steps_left + 1) /
+                         script->fade_step_num;
+                } else {
+                    br = (unsigned int)led->br *
+                         (script->fade_steps_left - 1) /
+                         script->fade_step_num;
+                }
             } else {
-                LEDS_BR[led->idx] = (unsigned int)led->br *
-                                    (script->fade_steps_left - 1) /
-                                    script->fade_step_num;
+                br = led->br;
             }
-        } else {
-            LEDS_BR[led->idx] = (unsigned int)led->br;
+            anim_layer_set(script->layer, led->idx, br);
         }
     }
 
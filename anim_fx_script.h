@@ -8,6 +8,9 @@
 #ifndef _ANIM_FX_SCRIPT_H
 #define _ANIM_FX_SCRIPT_H
 
+#include "leds.h"
+#include "anim_layer.h"
+#include "rng.h"
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -19,10 +22,10 @@ struct anim_fx_script_seg {
     /** Maximum number of steps */
     uint8_t         step_num_max;
     /** Brightness offset of each step */
-    int8_t          step_br_off;
-    /** Minimum step delay */
+    int16_t         step_br_off;
+    /** Minimum step delay, ticks */
     unsigned int    step_delay_min;
-    /** Maximum step delay */
+    /** Maximum step delay, ticks */
     unsigned int    step_delay_max;
 };
 
@@ -40,15 +43,15 @@ struct anim_fx_script_led_seg {
 /** State of an animated LED */
 struct anim_fx_script_led {
     /** LED index */
-    uint8_t                                 idx;
+    leds_idx                                idx;
     /** List of segment states */
     struct anim_fx_script_led_seg          *seg_list;
     /** Current segment index */
     uint8_t                                 seg_idx;
     /** Current segment's remaining steps */
     uint8_t                                 steps_left;
-    /** Current step's remaining delay */
-    unsigned int                            delay_left;
+    /** Time the current step ends at, since the animation start, ticks */
+    unsigned int                            deadline;
     /** Current brightness */
     uint8_t                                 br;
     /** Next brightness */
@@ -66,25 +69,39 @@ struct anim_fx_script {
     uint8_t                             led_num;
     /** Array of LED states [led_num] */
     struct anim_fx_script_led          *led_list;
+    /**
+     * Min-heap of indices into led_list [led_num], by LED deadline, then
+     * by index, with the LED due first at the top.
+     */
+    uint8_t                            *led_heap;
+
+    /** Random number stream to vary the segments with */
+    struct rng                         *rng;
+
+    /** Layer to draw the LEDs into */
+    struct anim_layer                  *layer;
 
     /** Number of fade-in/out steps */
-    uint8_t                             fade_step_num;
-    /** Delay (duration) of each fade step, ms */
+    uint16_t                            fade_step_num;
+    /** Delay (duration) of each fade step, ticks */
     unsigned int                        fade_step_delay;
 
     /** Number of fade-in/out steps left */
-    uint8_t                             fade_steps_left;
-    /** Delay left in current fade-in/out step, ms */
+    uint16_t                            fade_steps_left;
+    /** Delay left in current fade-in/out step, ticks */
     unsigned int                        fade_step_delay_left;
 
-    /** Animation duration (excluding fade-in/out), ms **/
+    /** Animation duration (excluding fade-in/out), ticks **/
     unsigned int                        duration;
 
     /**
      * Delay until the last step should take effect,
-     * since the previous one did, ms.
+     * since the previous one did, ticks.
      */
     unsigned int                        delay;
+
+    /** Time of the previous step, since the animation start, ticks */
+    unsigned int                        time;
 };
 
 /**
@@ -100,27 +117,37 @@ struct anim_fx_script {
  *                          led_list, and led_seg_list_list.
  * @param idx_list          Array of indices of LEDs to animate [led_num].
  * @param led_list          Array of animated LED states [led_num].
+ * @param led_heap          Array for the LED deadline heap [led_num].
  * @param led_seg_list_list List of segments states for each LED
  *                          [led_num * seg_num].
  * @param br                Initial LED brightness.
- * @param fade_delay        Fade-in/out delay, ms.
- * @param duration          Animation duration (excluding fade-in/out), ms.
+ * @param fade_delay        Fade-in/out delay, ticks.
+ * @param duration          Animation duration (excluding fade-in/out),
+ *                          ticks.
  *                          UINT_MAX for infinity (no fade-out).
+ * @param rng               Random number stream to vary the segments with.
+ * @param layer             Layer to draw the LEDs into.
  */
 extern void anim_fx_script_init(
                             struct anim_fx_script *script,
                             uint8_t seg_num,
                             const struct anim_fx_script_seg *seg_list,
                             uint8_t led_num,
-                            const uint8_t *idx_list,
+                            const leds_idx *idx_list,
                             struct anim_fx_script_led *led_list,
+                            uint8_t *led_heap,
                             struct anim_fx_script_led_seg *led_seg_list_list,
                             uint8_t br,
                             unsigned int fade_delay,
-                            unsigned int duration);
+                            unsigned int duration,
+                            struct rng *rng,
+                            struct anim_layer *layer);
 
 /**
  * Execute an scripted step with a specified state.
+ * Only the LEDs due at the step are advanced, and only the LEDs changing
+ * brightness are drawn into the layer, except while fading in or out, when
+ * all of them are.
  *
  * @param pdelay    Location for the delay after which the state updated by
  *                  this function should become active.
@@ -0,0 +1,88 @@
+/*
+ * Card animation brightness layers
+ */
+
+#include "anim_layer.h"
+
+/**
+ * Get the neutral brightness of a blend mode, which leaves the brightness
+ * below unchanged.
+ *
+ * @param blend The blend mode.
+ *
+ * @return The neutral brightness, zero for ANIM_LAYER_BLEND_REPLACE.
+ */
+static inline uint8_t
+anim_layer_neutral(enum anim_layer_blend blend)
+{
+    return blend == ANIM_LAYER_BLEND_MULTIPLY ? LEDS_BR_MAX : 0;
+}
+
+/**
+ * Set the brightness of an LED in a packed buffer.
+ *
+ * @param buf   The buffer to set the brightness in.
+ * @param idx   The LED index.
+ * @param br    The brightness to set.
+ */
+static inline void
+anim_layer_buf_set(uint8_t *buf, leds_idx idx, uint8_t br)
+{
+    size_t bit = (size_t)idx * LEDS_BR_BITS;
+    uint8_t *p = buf + bit / 8;
+    unsigned int word = p[0] | p[1] << 8;
+
+    word &= ~((unsigned int)LEDS_BR_MAX << (bit % 8));
+    word |= (unsigned int)(br & LEDS_BR_MAX) << (bit % 8);
+    p[0] = word;
+    p[1] = word >> 8;
+}
+
+void
+anim_layer_init(struct anim_layer *layer,
+                enum anim_layer_blend blend,
+                const leds_idx *led_list,
+                size_t led_num)
+{
+    uint8_t neutral = anim_layer_neutral(blend);
+    size_t i;
+
+    layer->blend = blend;
+    for (i = 0; i < sizeof(layer->cover); i++) {
+        layer->cover[i] = 0;
+    }
+    for (i = 0; i < led_num; i++) {
+        layer->cover[led_list[i] / 8] |= 1 << (led_list[i] % 8);
+    }
+    for (i = 0; i < LEDS_NUM; i++) {
+        anim_layer_buf_set(layer->next, i, neutral);
+        anim_layer_buf_set(layer->cur, i, neutral);
+    }
+    layer->next_opaque_num = 0;
+    layer->cur_opaque_num = 0;
+}
+
+void
+anim_layer_set(struct anim_layer *layer, leds_idx idx, uint8_t br)
+{
+    uint8_t neutral = anim_layer_neutral(layer->blend);
+    uint8_t prev = anim_layer_buf_get(layer->next, idx);
+
+    if (prev == neutral && br != neutral) {
+        layer->next_opaque_num++;
+    } else if (prev != neutral && br == neutral) {
+        layer->next_opaque_num--;
+    }
+    anim_layer_buf_set(layer->next, idx, br);
+}
+
+void
+anim_layer_commit(struct anim_layer *layer)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(layer->cur); i++) {
+        layer->cur[i] = layer->next[i];
+    }
+    layer->cur_opaque_num = layer->next_opaque_num;
+}
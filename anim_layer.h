@@ -0,0 +1,175 @@
+/*
+ * Card animation brightness layers
+ *
+ * Each animation thread draws into its own layer, instead of LEDS_BR, and
+ * the layers are composited into LEDS_BR, bottom to top, with the blend
+ * mode of each. A layer covers only the LEDs of its thread's zone, so
+ * threads with disjoint zones don't affect each other, and a thread with
+ * a zone overlapping another's blends over it.
+ *
+ * Brightness is packed in LEDS_BR_BITS bits per LED. Layers are double
+ * buffered: effects draw the next state, coming into effect at the
+ * thread's deadline, while the current state stays available to
+ * composite the LEDs of other threads until then.
+ */
+
+#ifndef _ANIM_LAYER_H
+#define _ANIM_LAYER_H
+
+#include "leds.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Layer blend modes */
+enum anim_layer_blend {
+    /** Replace the brightness below */
+    ANIM_LAYER_BLEND_REPLACE,
+    /** Take the maximum of the brightness below and the layer's */
+    ANIM_LAYER_BLEND_MAX,
+    /** Add the layer's brightness to the one below, saturating */
+    ANIM_LAYER_BLEND_ADD,
+    /** Scale the brightness below by the layer's, as a fraction of max */
+    ANIM_LAYER_BLEND_MULTIPLY,
+};
+
+/** Size of a packed layer brightness buffer, plus one byte of slack */
+#define ANIM_LAYER_BUF_SIZE ((LEDS_NUM * LEDS_BR_BITS + 7) / 8 + 1)
+
+/** Brightness layer */
+struct anim_layer {
+    /** Blend mode */
+    enum anim_layer_blend   blend;
+    /** Bitmap of the LEDs covered by the layer */
+    uint8_t                 cover[(LEDS_NUM + 7) / 8];
+    /** Packed brightness of the next state, drawn by the effects */
+    uint8_t                 next[ANIM_LAYER_BUF_SIZE];
+    /** Packed brightness of the current state */
+    uint8_t                 cur[ANIM_LAYER_BUF_SIZE];
+    /**
+     * Number of LEDs in the next state, which don't have the blend
+     * mode's neutral brightness (not used for ANIM_LAYER_BLEND_REPLACE).
+     */
+    leds_idx                next_opaque_num;
+    /** Same as next_opaque_num, but for the current state */
+    leds_idx                cur_opaque_num;
+};
+
+/**
+ * Initialize a layer, with both states transparent, that is having
+ * neutral brightness for the blend mode (zero for
+ * ANIM_LAYER_BLEND_REPLACE).
+ *
+ * @param layer     The layer to initialize.
+ * @param blend     The blend mode of the layer.
+ * @param led_list  Array of indexes of LEDs covered by the layer.
+ * @param led_num   Number of indexes in led_list.
+ */
+extern void anim_layer_init(struct anim_layer *layer,
+                            enum anim_layer_blend blend,
+                            const leds_idx *led_list,
+                            size_t led_num);
+
+/**
+ * Get the brightness of an LED from a packed buffer.
+ *
+ * @param buf   The buffer to get the brightness from.
+ * @param idx   The LED index.
+ *
+ * @return The brightness.
+ */
+static inline uint8_t
+anim_layer_buf_get(const uint8_t *buf, leds_idx idx)
+{
+    size_t bit = (size_t)idx * LEDS_BR_BITS;
+    const uint8_t *p = buf + bit / 8;
+    return ((p[0] | p[1] << 8) >> (bit % 8)) & LEDS_BR_MAX;
+}
+
+/**
+ * Get the brightness of an LED in the next state of a layer.
+ *
+ * @param layer The layer to get the brightness from.
+ * @param idx   The LED index.
+ *
+ * @return The brightness.
+ */
+static inline uint8_t
+anim_layer_get(const struct anim_layer *layer, leds_idx idx)
+{
+    return anim_layer_buf_get(layer->next, idx);
+}
+
+/**
+ * Set the brightness of an LED in the next state of a layer.
+ *
+ * @param layer The layer to set the brightness in.
+ * @param idx   The index of an LED covered by the layer.
+ * @param br    The brightness to set.
+ */
+extern void anim_layer_set(struct anim_layer *layer, leds_idx idx,
+                           uint8_t br);
+
+/**
+ * Make the next state of a layer current, keeping it as the base for
+ * drawing the following state.
+ *
+ * @param layer The layer to commit.
+ */
+extern void anim_layer_commit(struct anim_layer *layer);
+
+/**
+ * Check if a state of a layer is fully transparent, and so can be skipped
+ * when compositing.
+ *
+ * @param layer The layer to check.
+ * @param next  True to check the next state, false for the current one.
+ *
+ * @return True if the state is transparent, false otherwise.
+ */
+static inline bool
+anim_layer_transparent(const struct anim_layer *layer, bool next)
+{
+    return layer->blend != ANIM_LAYER_BLEND_REPLACE &&
+           (next ? layer->next_opaque_num : layer->cur_opaque_num) == 0;
+}
+
+/**
+ * Check if a layer covers an LED.
+ *
+ * @param layer The layer to check.
+ * @param idx   The LED index.
+ *
+ * @return True if the layer covers the LED, false otherwise.
+ */
+static inline bool
+anim_layer_covers(const struct anim_layer *layer, leds_idx idx)
+{
+    return layer->cover[idx / 8] >> (idx % 8) & 1;
+}
+
+/**
+ * Blend an LED's brightness from a layer over the brightness below it.
+ *
+ * @param blend The layer's blend mode.
+ * @param below The brightness below the layer.
+ * @param br    The layer's brightness.
+ *
+ * @return The blended brightness.
+ */
+static inline uint8_t
+anim_layer_blend(enum anim_layer_blend blend, uint8_t below, uint8_t br)
+{
+    switch (blend) {
+    case ANIM_LAYER_BLEND_MAX:
+        return below > br ? below : br;
+    case ANIM_LAYER_BLEND_ADD:
+        return below + br > LEDS_BR_MAX ? LEDS_BR_MAX : below + br;
+    case ANIM_LAYER_BLEND_MULTIPLY:
+        return (unsigned int)below * br / LEDS_BR_MAX;
+    default:
+        return br;
+    }
+}
+
+#endif /* _ANIM_LAYER_H */
@@ -0,0 +1,138 @@
+/*
+ * Precompiled animation stream player
+ *
+ * Implements the card animation by playing back the stream generated by
+ * anim-compile (see anim_stream.h), instead of running the effects.
+ */
+
+#include "anim.h"
+#include "anim_play.h"
+#include "anim_stream.h"
+#include "leds.h"
+#include <prng.h>
+#include <stdbool.h>
+
+#if LEDS_CARD_NUM > 255
+#error "Animation stream supports up to 255 card LEDs"
+#endif
+
+/** Offset of the next record to play in ANIM_STREAM */
+static size_t ANIM_PLAY_OFF = 0;
+
+/** List of indexes of LEDs changed by the records advanced over */
+static leds_idx ANIM_PLAY_LIST[LEDS_CARD_NUM];
+
+/** Number of indexes in ANIM_PLAY_LIST */
+static size_t ANIM_PLAY_NUM = 0;
+
+/** Bitmap of the LEDs in ANIM_PLAY_LIST */
+static uint8_t ANIM_PLAY_MAP[(LEDS_CARD_NUM + 7) / 8];
+
+/**
+ * List of indexes of LEDs rendered by the previous render, and not yet
+ * into the swapped bank
+ */
+static leds_idx ANIM_PLAY_PREV_LIST[LEDS_CARD_NUM];
+
+/** Number of indexes in ANIM_PLAY_PREV_LIST */
+static size_t ANIM_PLAY_PREV_NUM = 0;
+
+void
+anim_play_seek(unsigned int time)
+{
+    size_t i;
+
+    for (i = 1; i < ANIM_STREAM_KEY_NUM &&
+                ANIM_STREAM_KEY_LIST[i].time <= time; i++);
+    ANIM_PLAY_OFF = ANIM_STREAM_KEY_LIST[i - 1].off;
+    for (i = 0; i < ANIM_PLAY_NUM; i++) {
+        ANIM_PLAY_MAP[ANIM_PLAY_LIST[i] / 8] = 0;
+    }
+    ANIM_PLAY_NUM = 0;
+    ANIM_PLAY_PREV_NUM = 0;
+}
+
+void
+anim_init(void)
+{
+    /* Start at a random key record */
+    anim_play_seek(ANIM_STREAM_KEY_LIST[prng_next() %
+                                        ANIM_STREAM_KEY_NUM].time);
+}
+
+unsigned int
+anim_advance(void)
+{
+    const uint8_t *p;
+    const uint8_t *led_list;
+    const uint8_t *br_list;
+    size_t led_num;
+    size_t i;
+    leds_idx idx;
+    unsigned int delay = 0;
+    unsigned int shift = 0;
+    bool wrap;
+
+    /* Wrap around to the first record at the end */
+    wrap = ANIM_PLAY_OFF >= ANIM_STREAM_LEN;
+    if (wrap) {
+        ANIM_PLAY_OFF = 0;
+    }
+
+    /* Decode the record */
+    p = ANIM_STREAM + ANIM_PLAY_OFF;
+    do {
+        delay |= (*p & 0x7f) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+    if (wrap) {
+        delay = ANIM_STREAM_LOOP_DELAY;
+    }
+    led_num = *p++;
+    led_list = p;
+    br_list = p + led_num;
+
+    /* Apply the changed LEDs, and add them to the ones to render */
+    for (i = 0; i < led_num; i++) {
+        idx = led_list[i];
+        LEDS_BR[idx] = br_list[i];
+        if (!(ANIM_PLAY_MAP[idx / 8] & 1 << (idx % 8))) {
+            ANIM_PLAY_MAP[idx / 8] |= 1 << (idx % 8);
+            ANIM_PLAY_LIST[ANIM_PLAY_NUM++] = idx;
+        }
+    }
+
+    ANIM_PLAY_OFF = br_list + led_num - ANIM_STREAM;
+
+    return ANIM_MS(delay);
+}
+
+void
+anim_render(void)
+{
+    size_t i;
+
+    /*
+     * Bring the swapped bank up to the previous render, and render the
+     * LEDs changed by the steps advanced over since then
+     */
+    leds_render_list(ANIM_PLAY_PREV_LIST, ANIM_PLAY_PREV_NUM);
+    leds_render_list(ANIM_PLAY_LIST, ANIM_PLAY_NUM);
+    leds_render_finish();
+
+    /* Have the swapped bank brought up to this render, next time */
+    for (i = 0; i < ANIM_PLAY_NUM; i++) {
+        ANIM_PLAY_PREV_LIST[i] = ANIM_PLAY_LIST[i];
+        ANIM_PLAY_MAP[ANIM_PLAY_LIST[i] / 8] = 0;
+    }
+    ANIM_PLAY_PREV_NUM = ANIM_PLAY_NUM;
+    ANIM_PLAY_NUM = 0;
+}
+
+unsigned int
+anim_step(void)
+{
+    unsigned int delay = anim_advance();
+    anim_render();
+    return delay;
+}
@@ -0,0 +1,16 @@
+/*
+ * Precompiled animation stream player
+ */
+
+#ifndef _ANIM_PLAY_H
+#define _ANIM_PLAY_H
+
+/**
+ * Continue playing the animation stream from the last key record at, or
+ * before the specified time. The next animation step will render all LEDs.
+ *
+ * @param time  Time since the stream start, milliseconds.
+ */
+extern void anim_play_seek(unsigned int time);
+
+#endif /* _ANIM_PLAY_H */
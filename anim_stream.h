@@ -0,0 +1,54 @@
+/*
+ * Precompiled animation stream
+ *
+ * The stream is generated by anim-compile (see anim_compile.c) from the
+ * animation effects, and is played back by anim_play.c instead of running
+ * them. It is a sequence of records, one per animation step, each
+ * consisting of:
+ *
+ *  - the step delay in milliseconds since the previous step, as an
+ *    unsigned LEB128 number (7 bits per byte, lowest first, top bit set on
+ *    all bytes but the last),
+ *  - the number of LEDs whose brightness changed since the previous step,
+ *    one byte,
+ *  - the indexes of those LEDs, one byte each, covering only the card LEDs
+ *    (see LEDS_CARD_NUM), as extra LEDs driven after them stay dark,
+ *  - the new brightness of those LEDs, one byte each, in the same order.
+ *
+ * Key records list all card LEDs, so playback can start from them. The
+ * stream begins with one, and the key list points to them all.
+ */
+
+#ifndef _ANIM_STREAM_H
+#define _ANIM_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Key record reference */
+struct anim_stream_key {
+    /** Time of the record since the stream start, milliseconds */
+    uint32_t    time;
+    /** Offset of the record in the stream, bytes */
+    uint32_t    off;
+};
+
+/** The stream data */
+extern const uint8_t ANIM_STREAM[];
+
+/** Length of the stream data, bytes */
+extern const size_t ANIM_STREAM_LEN;
+
+/**
+ * Delay from the last stream record to the first, on wrap-around, ms.
+ * The first record's own delay is from the start of the stream.
+ */
+extern const unsigned int ANIM_STREAM_LOOP_DELAY;
+
+/** List of key records, in order of time */
+extern const struct anim_stream_key ANIM_STREAM_KEY_LIST[];
+
+/** Number of key records in ANIM_STREAM_KEY_LIST */
+extern const size_t ANIM_STREAM_KEY_NUM;
+
+#endif /* _ANIM_STREAM_H */
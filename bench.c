@@ -0,0 +1,611 @@
+/*
+ * Render and animation benchmark
+ *
+ * Times leds_render() and leds_render_list() in a few typical situations,
+ * to compare the render kernels selected with LEDS_RENDER (see Makefile),
+ * and, on the board, sending a PWM step, as the tick handler does, to see
+ * how both scale with the driver chain length set with LEDS_DRV_NUM. Also
+ * times the animation: steps of the scripted effects alone, steps of each
+ * balls effect, rendered the way anim_step() renders a thread, and
+ * anim_step() itself.
+ *
+ * On the board, the results are left in BENCH_RESULT_LIST, in HCLK
+ * cycles, to be inspected with a debugger. On the host, the results are
+ * printed as JSON, in nanoseconds, which can be saved as a baseline, and
+ * passed back to check the results against:
+ *
+ *      bench-host [BASELINE]
+ *
+ * A result regresses if its median exceeds the baseline median by more
+ * than the threshold percentage stored with it, and if any does, the exit
+ * status is 1. Medians are compared, since means include the runs the
+ * host preempted, and minimums of the animation benchmarks only show their
+ * cheapest steps.
+ */
+#include "leds.h"
+#include "prof.h"
+#include "anim.h"
+#include "anim_fx.h"
+#include "anim_layer.h"
+#include "rng.h"
+#include <prng.h>
+#include <misc.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <init.h>
+#include <rcc.h>
+#include <gpio.h>
+#include <spi.h>
+#ifdef HOST
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#endif
+
+/** Number of times to run each benchmark */
+#ifdef HOST
+#define BENCH_RUN_NUM   100000
+#else
+#define BENCH_RUN_NUM   1000
+#endif
+
+/**
+ * Default regression threshold, percent of the baseline median, for
+ * results recorded without a baseline
+ */
+#ifndef BENCH_THRESHOLD
+#define BENCH_THRESHOLD 25
+#endif
+
+#ifdef HOST
+/** Unit of the benchmark results */
+#define BENCH_UNIT      "ns"
+
+/**
+ * Read the benchmark clock.
+ *
+ * @return Current time, nanoseconds, rolling over every ~4s.
+ */
+static uint32_t
+bench_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#else
+/** Unit of the benchmark results */
+#define BENCH_UNIT      "cycles"
+
+/**
+ * Read the benchmark clock.
+ *
+ * @return Current cycle count.
+ */
+static uint32_t
+bench_clock(void)
+{
+    return prof_cycles();
+}
+#endif
+
+/** Benchmark description */
+struct bench {
+    /** Name */
+    const char         *name;
+    /** Set up before the runs, or NULL if not needed */
+    void              (*start)(const struct bench *bench);
+    /** Prepare LEDS_BR for the next run */
+    void              (*prepare)(const struct bench *bench);
+    /** Run the measured code */
+    void              (*run)(const struct bench *bench);
+    /** Array of indexes of LEDs to render or animate */
+    const leds_idx     *led_list;
+    /** Number of indexes in led_list */
+    uint8_t             led_num;
+    /** Effect to step, for the animation benchmarks */
+    anim_fx_fn          fx;
+    /** Arena for the effect state */
+    struct anim_fx_arena   *arena;
+};
+
+/** Benchmark result */
+struct bench_result {
+    /** Benchmark name */
+    const char         *name;
+    /** Run time statistics, in BENCH_UNIT, minus the clock overhead */
+    struct prof_stat    stat;
+#ifdef HOST
+    /** Median run time, in BENCH_UNIT, minus the clock overhead */
+    uint32_t            median;
+#endif
+};
+
+/** Context of the effect being benchmarked */
+static struct anim_fx_ctx BENCH_FX_CTX;
+
+/** Layer of the effect being benchmarked */
+static struct anim_layer BENCH_FX_LAYER;
+
+/** True if the effect being benchmarked is to make its first step */
+static bool BENCH_FX_FIRST;
+
+/**
+ * Get a random brightness, lighting an LED at least for one PWM time unit.
+ *
+ * @return The brightness.
+ */
+static uint8_t
+bench_br_random(void)
+{
+    return 7 + prng_next() % (LEDS_BR_NUM - 7);
+}
+
+/** Set all LEDs to random brightness */
+static void
+bench_prepare_random(const struct bench *bench)
+{
+    size_t i;
+    (void)bench;
+    for (i = 0; i < LEDS_NUM; i++) {
+        LEDS_BR[i] = bench_br_random();
+    }
+}
+
+/** Set the benchmark's LEDs to random brightness */
+static void
+bench_prepare_list_random(const struct bench *bench)
+{
+    size_t i;
+    for (i = 0; i < bench->led_num; i++) {
+        LEDS_BR[bench->led_list[i]] = bench_br_random();
+    }
+}
+
+/** Turn all balls off, or set them to random brightness, in turns */
+static void
+bench_prepare_balls_all(const struct bench *bench)
+{
+    static bool on = false;
+    size_t i;
+    (void)bench;
+    on = !on;
+    for (i = 0; i < LEDS_BALLS_NUM; i++) {
+        LEDS_BR[LEDS_BALLS_LIST[i]] = on ? bench_br_random() : 0;
+    }
+}
+
+/** Turn one random ball fully on, or off */
+static void
+bench_prepare_balls_one(const struct bench *bench)
+{
+    uint8_t *br = &LEDS_BR[LEDS_BALLS_LIST[prng_next() % LEDS_BALLS_NUM]];
+    (void)bench;
+    *br = *br == 0 ? LEDS_BR_MAX : 0;
+}
+
+/** Leave the LEDs as they are */
+static void
+bench_prepare_none(const struct bench *bench)
+{
+    (void)bench;
+}
+
+/** Render all LEDs */
+static void
+bench_run_all(const struct bench *bench)
+{
+    (void)bench;
+    leds_render();
+}
+
+/** Render the benchmark's LEDs */
+static void
+bench_run_list(const struct bench *bench)
+{
+    leds_render_list(bench->led_list, bench->led_num);
+}
+
+#if !defined(LEDS_DMA) && !defined(HOST)
+/** Send a PWM step and wait for it to leave, as the tick handler does */
+static void
+bench_run_step_send(const struct bench *bench)
+{
+    (void)bench;
+    leds_step_send(0);
+    leds_step_flush();
+}
+#endif
+
+/** Set up the benchmark's effect on its LEDs, to start on the next step */
+static void
+bench_start_fx(const struct bench *bench)
+{
+    BENCH_FX_CTX.led_list = bench->led_list;
+    BENCH_FX_CTX.led_num = bench->led_num;
+    BENCH_FX_CTX.arena = bench->arena;
+    BENCH_FX_CTX.state = NULL;
+    BENCH_FX_CTX.balls_random_last = 0;
+    rng_init(&BENCH_FX_CTX.rng, 1, 0);
+    anim_layer_init(&BENCH_FX_LAYER, ANIM_LAYER_BLEND_REPLACE,
+                    bench->led_list, bench->led_num);
+    BENCH_FX_CTX.layer = &BENCH_FX_LAYER;
+    BENCH_FX_FIRST = true;
+}
+
+/**
+ * Make a step of the benchmark's effect, restarting it when it's over,
+ * instead of moving on to the next effect.
+ */
+static void
+bench_run_fx(const struct bench *bench)
+{
+    anim_fx_fn fx = bench->fx;
+    fx(&BENCH_FX_CTX, BENCH_FX_FIRST, (void **)&fx);
+    BENCH_FX_FIRST = fx != bench->fx;
+}
+
+/**
+ * Make a step of the benchmark's effect, and render it, the way
+ * anim_step() does for an animation thread.
+ */
+static void
+bench_run_fx_render(const struct bench *bench)
+{
+    size_t i;
+    leds_idx idx;
+
+    bench_run_fx(bench);
+    for (i = 0; i < bench->led_num; i++) {
+        idx = bench->led_list[i];
+        LEDS_BR[idx] = anim_layer_get(&BENCH_FX_LAYER, idx);
+    }
+    leds_render_list(bench->led_list, bench->led_num);
+    leds_render_finish();
+}
+
+/** Start the animation */
+static void
+bench_start_anim(const struct bench *bench)
+{
+    (void)bench;
+    anim_init();
+}
+
+/** Make an animation step */
+static void
+bench_run_anim(const struct bench *bench)
+{
+    (void)bench;
+    anim_step();
+}
+
+/**
+ * Describe a benchmark rendering a list of LEDs.
+ *
+ * @param _name     Name of the benchmark.
+ * @param _prepare  The function preparing LEDS_BR.
+ * @param _group    Name of the LED group, e.g. BALLS.
+ */
+#define BENCH_LIST_RENDER(_name, _prepare, _group) \
+    {.name = _name, .prepare = _prepare, .run = bench_run_list,         \
+     .led_list = LEDS_##_group##_LIST, .led_num = LEDS_##_group##_NUM}
+
+/**
+ * Describe a benchmark stepping an effect.
+ *
+ * @param _name     Name of the benchmark.
+ * @param _run      The function stepping the effect.
+ * @param _group    Name of the LED group to animate, e.g. BALLS.
+ * @param _fx       The effect-stepping function.
+ */
+#define BENCH_FX(_name, _run, _group, _fx) \
+    {.name = _name, .start = bench_start_fx,                            \
+     .prepare = bench_prepare_none, .run = _run,                        \
+     .led_list = LEDS_##_group##_LIST, .led_num = LEDS_##_group##_NUM,  \
+     .fx = _fx, .arena = &ANIM_FX_##_group##_ARENA}
+
+/** List of benchmarks */
+static const struct bench BENCH_LIST[] = {
+    {.name = "render_all",
+     .prepare = bench_prepare_random, .run = bench_run_all},
+    BENCH_LIST_RENDER("render_stars", bench_prepare_list_random, STARS),
+    BENCH_LIST_RENDER("render_topper", bench_prepare_list_random, TOPPER),
+    BENCH_LIST_RENDER("render_balls", bench_prepare_list_random, BALLS),
+    BENCH_LIST_RENDER("render_balls_all", bench_prepare_balls_all, BALLS),
+    BENCH_LIST_RENDER("render_balls_one", bench_prepare_balls_one, BALLS),
+    BENCH_LIST_RENDER("render_balls_none", bench_prepare_none, BALLS),
+#if !defined(LEDS_DMA) && !defined(HOST)
+    {.name = "step_send",
+     .prepare = bench_prepare_none, .run = bench_run_step_send},
+#endif
+    BENCH_FX("script_stars_shimmer", bench_run_fx,
+             STARS, anim_fx_stars_shimmer),
+    BENCH_FX("script_balls_glitter", bench_run_fx,
+             BALLS, anim_fx_balls_glitter),
+    BENCH_FX("script_balls_shimmer", bench_run_fx,
+             BALLS, anim_fx_balls_shimmer),
+    BENCH_FX("script_balls_flare", bench_run_fx,
+             BALLS, anim_fx_balls_flare),
+    BENCH_FX("anim_balls_fade_in_and_out", bench_run_fx_render,
+             BALLS, anim_fx_balls_fade_in_and_out),
+    BENCH_FX("anim_balls_wave", bench_run_fx_render,
+             BALLS, anim_fx_balls_wave),
+    BENCH_FX("anim_balls_glitter", bench_run_fx_render,
+             BALLS, anim_fx_balls_glitter),
+    BENCH_FX("anim_balls_cycle_colors", bench_run_fx_render,
+             BALLS, anim_fx_balls_cycle_colors),
+    BENCH_FX("anim_balls_snow", bench_run_fx_render,
+             BALLS, anim_fx_balls_snow),
+    BENCH_FX("anim_balls_shimmer", bench_run_fx_render,
+             BALLS, anim_fx_balls_shimmer),
+    BENCH_FX("anim_balls_shoot", bench_run_fx_render,
+             BALLS, anim_fx_balls_shoot),
+    BENCH_FX("anim_balls_flare", bench_run_fx_render,
+             BALLS, anim_fx_balls_flare),
+    /* Last, as the animation threads share the effect arenas */
+    {.name = "anim_step", .start = bench_start_anim,
+     .prepare = bench_prepare_none, .run = bench_run_anim},
+};
+
+/** Results of the benchmarks */
+volatile struct bench_result BENCH_RESULT_LIST[ARRAY_SIZE(BENCH_LIST)];
+
+#ifdef HOST
+/** Run times of the benchmark being run, to take the median of */
+static uint32_t BENCH_TIME_LIST[BENCH_RUN_NUM];
+
+/**
+ * Compare two run times, for qsort().
+ *
+ * @param a Pointer to the first run time.
+ * @param b Pointer to the second run time.
+ *
+ * @return Negative, zero, or positive, if a is less than, equal to, or
+ *         greater than b, respectively.
+ */
+static int
+bench_time_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/** Maximum length of a baseline line, and of a benchmark name */
+#define BENCH_LINE_MAX  256
+
+/** Baseline of a benchmark result */
+struct bench_baseline {
+    /** True if the baseline has the result */
+    bool        found;
+    /** Baseline median, in BENCH_UNIT */
+    uint32_t    median;
+    /** Regression threshold, percent of the baseline median */
+    uint32_t    threshold;
+};
+
+/** Baselines of the benchmarks */
+static struct bench_baseline BENCH_BASELINE_LIST[ARRAY_SIZE(BENCH_LIST)];
+
+/**
+ * Load the baselines of the benchmarks from results output earlier.
+ * Results of unknown benchmarks are ignored.
+ *
+ * @param path  Path to the file with the results.
+ *
+ * @return True if loaded, false if failed to read the file.
+ */
+static bool
+bench_baseline_load(const char *path)
+{
+    FILE *file;
+    char line[BENCH_LINE_MAX];
+    char name[BENCH_LINE_MAX];
+    const char *p;
+    unsigned int median;
+    unsigned int threshold;
+    size_t i;
+
+    file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    /* Each result is on a line of its own */
+    while (fgets(line, sizeof(line), file) != NULL) {
+        p = strstr(line, "\"name\": \"");
+        if (p == NULL || sscanf(p, "\"name\": \"%255[^\"]", name) != 1) {
+            continue;
+        }
+        p = strstr(line, "\"median\": ");
+        if (p == NULL || sscanf(p, "\"median\": %u", &median) != 1) {
+            continue;
+        }
+        p = strstr(line, "\"threshold\": ");
+        if (p == NULL || sscanf(p, "\"threshold\": %u", &threshold) != 1) {
+            threshold = BENCH_THRESHOLD;
+        }
+        for (i = 0; i < ARRAY_SIZE(BENCH_LIST); i++) {
+            if (strcmp(BENCH_LIST[i].name, name) == 0) {
+                BENCH_BASELINE_LIST[i].found = true;
+                BENCH_BASELINE_LIST[i].median = median;
+                BENCH_BASELINE_LIST[i].threshold = threshold;
+            }
+        }
+    }
+    if (ferror(file)) {
+        perror(path);
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * Output the results as JSON, one result per line, checking them against
+ * the baselines, if loaded.
+ *
+ * @return True if no result regressed, false otherwise.
+ */
+static bool
+bench_report(void)
+{
+    const volatile struct bench_result *result;
+    const struct bench_baseline *baseline;
+    uint32_t mean;
+    uint32_t threshold;
+    bool regressed;
+    bool ok = true;
+    size_t i;
+
+    printf("{\n    \"unit\": \"" BENCH_UNIT "\",\n"
+           "    \"runs\": %u,\n    \"results\": [\n", BENCH_RUN_NUM);
+    for (i = 0; i < ARRAY_SIZE(BENCH_RESULT_LIST); i++) {
+        result = &BENCH_RESULT_LIST[i];
+        baseline = &BENCH_BASELINE_LIST[i];
+        mean = prof_stat_mean(&result->stat);
+        threshold = baseline->found ? baseline->threshold : BENCH_THRESHOLD;
+        printf("        {\"name\": \"%s\", "
+               "\"min\": %u, \"median\": %u, \"mean\": %u, "
+               "\"max\": %u, \"threshold\": %u",
+               result->name, result->stat.min, result->median, mean,
+               result->stat.max, threshold);
+        if (baseline->found) {
+            regressed = (uint64_t)result->median * 100 >
+                        (uint64_t)baseline->median * (100 + threshold);
+            printf(", \"baseline\": %u, \"regressed\": %s",
+                   baseline->median, regressed ? "true" : "false");
+            if (regressed) {
+                fprintf(stderr,
+                        "%s: median %u " BENCH_UNIT " exceeds baseline "
+                        "%u " BENCH_UNIT " by more than %u%%\n",
+                        result->name, result->median, baseline->median,
+                        threshold);
+                ok = false;
+            }
+        }
+        printf("}%s\n", i + 1 < ARRAY_SIZE(BENCH_RESULT_LIST) ? "," : "");
+    }
+    printf("    ]\n}\n");
+    return ok;
+}
+#endif
+
+/**
+ * Measure the overhead of reading the benchmark clock.
+ *
+ * @return The minimum overhead, in BENCH_UNIT.
+ */
+static uint32_t
+bench_overhead(void)
+{
+    struct prof_stat stat = {0, };
+    size_t i;
+    uint32_t start;
+
+    for (i = 0; i < BENCH_RUN_NUM; i++) {
+        start = bench_clock();
+        prof_stat_add(&stat, bench_clock() - start);
+    }
+    return stat.min;
+}
+
+/**
+ * Run a benchmark.
+ *
+ * @param bench     The benchmark to run.
+ * @param overhead  The clock overhead to subtract.
+ * @param result    Location for the result.
+ */
+static void
+bench_run(const struct bench *bench, uint32_t overhead,
+          volatile struct bench_result *result)
+{
+    size_t i;
+    uint32_t start, time;
+
+    result->name = bench->name;
+    if (bench->start != NULL) {
+        bench->start(bench);
+    }
+    for (i = 0; i < BENCH_RUN_NUM; i++) {
+        bench->prepare(bench);
+        start = bench_clock();
+        bench->run(bench);
+        time = bench_clock() - start;
+        time = time > overhead ? time - overhead : 0;
+        prof_stat_add(&result->stat, time);
+#ifdef HOST
+        BENCH_TIME_LIST[i] = time;
+#endif
+    }
+#ifdef HOST
+    qsort(BENCH_TIME_LIST, BENCH_RUN_NUM, sizeof(*BENCH_TIME_LIST),
+          bench_time_cmp);
+    result->median = BENCH_TIME_LIST[BENCH_RUN_NUM / 2];
+#endif
+}
+
+#ifdef HOST
+int
+main(int argc, char **argv)
+#else
+int
+main(void)
+#endif
+{
+    size_t i;
+    uint32_t overhead;
+
+#ifdef HOST
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [BASELINE]\n", argv[0]);
+        return 2;
+    }
+    if (argc == 2 && !bench_baseline_load(argv[1])) {
+        return 2;
+    }
+#endif
+
+#ifndef HOST
+    /* Basic init */
+    init();
+
+    /* Enable cycle counting */
+    prof_cycles_init();
+#endif
+
+    /* Set up the SPI and the LEDs the way the card does */
+    RCC->apb2enr |= RCC_APB2ENR_IOPAEN_MASK | RCC_APB2ENR_SPI1EN_MASK;
+    gpio_pin_set(GPIO_A, 4, false);
+    gpio_pin_conf(GPIO_A, 4,
+                  GPIO_MODE_OUTPUT_2MHZ, GPIO_CNF_OUTPUT_GP_PUSH_PULL);
+    SPI1->cr1 = (SPI1->cr1 &
+                 ~(SPI_CR1_BR_MASK | SPI_CR1_MSTR_MASK | SPI_CR1_SPE_MASK |
+                   SPI_CR1_SSM_MASK | SPI_CR1_SSI_MASK)) |
+                (SPI_CR1_BR_VAL_FPCLK_DIV8 << SPI_CR1_BR_LSB) |
+                (SPI_CR1_MSTR_VAL_MASTER << SPI_CR1_MSTR_LSB) |
+                SPI_CR1_SSM_MASK | SPI_CR1_SSI_MASK | SPI_CR1_SPE_MASK;
+    leds_init(SPI1, GPIO_A, 4);
+
+    /* Use fixed seed, so kernels get the same input */
+    prng_seed(1);
+
+    overhead = bench_overhead();
+    for (i = 0; i < ARRAY_SIZE(BENCH_LIST); i++) {
+        bench_run(&BENCH_LIST[i], overhead, &BENCH_RESULT_LIST[i]);
+    }
+
+#ifdef HOST
+    return bench_report() ? 0 : 1;
+#else
+    while (true) {
+        asm ("wfi");
+    }
+#endif
+}
@@ -5,9 +5,15 @@
  * A5 - SCK     - CLK
  * A6 - MISO    - SDO
  * A7 - MOSI    - SDI
+ *
+ * With LEDS_GAIN defined, also:
+ *
+ * A3 - GPIO    - OE(ED2)
  */
 #include "anim.h"
 #include "leds.h"
+#include "prof.h"
+#include "stack.h"
 #include <rcc.h>
 #include <gpio.h>
 #include <init.h>
@@ -16,15 +22,27 @@
 #include <prng.h>
 #include <spi.h>
 #include <stk.h>
+#if defined(LEDS_DMA) || defined(TICKLESS)
+#include <nvic.h>
+#endif
 #include <misc.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+#ifdef HOST
+#include <sim.h>
+/** Wait for interrupt */
+#define WFI()   sim_wfi()
+#else
+/** Wait for interrupt */
+#define WFI()   asm ("wfi")
+#endif
+
 /* SPI peripheral to use to talk to LEDs */
 static volatile struct spi *SPI = SPI1;
 
-/* Systick handler step */
+/* Systick handler step (tick count) */
 static volatile unsigned int SYSTICK_STEP = 0;
 /* True if systick handler must swap LED banks */
 static volatile bool SYSTICK_SWAP_WAIT = false;
@@ -39,38 +57,325 @@ static volatile unsigned int SYSTICK_SWAP_LAST = 0;
 /* The maxmimum lag for swap step time to be considered not overrun */
 #define SYSTICK_SWAP_LAG    ((unsigned int)1 << 31)
 
-/** Systick handler */
+/* Number of HCLK cycles per SPI bit, with SPI running at APB2clk/8 */
+#define SPI_BIT_CYCLES  8
+
+/*
+ * Number of HCLK cycles a tick handler can take sending a PWM step through
+ * the driver chain, including a margin for the handler overhead.
+ */
+#define SYSTICK_SEND_CYCLES (LEDS_NUM * SPI_BIT_CYCLES + 300)
+
+#if SYSTICK_SEND_CYCLES > 3000
+#error "The driver chain is too long to send a PWM step in a tick"
+#endif
+
+/*
+ * Number of SYSTICK_STEP ticks per millisecond: 48 for PWM frequency of
+ * 375Hz, or less, for the chains too long to send a step in a tick. Kept
+ * to divisors of the HCLK kHz, so ticks are an exact number of cycles.
+ */
+#define SYSTICK_MS_TICKS \
+    (SYSTICK_SEND_CYCLES <= 1500 ? 48 : \
+     SYSTICK_SEND_CYCLES <= 1800 ? 40 : \
+     SYSTICK_SEND_CYCLES <= 2000 ? 36 : \
+     SYSTICK_SEND_CYCLES <= 2250 ? 32 : \
+     SYSTICK_SEND_CYCLES <= 2400 ? 30 : 24)
+
+/* Number of HCLK cycles per SYSTICK_STEP tick */
+#define SYSTICK_TICK_CYCLES (72000 / SYSTICK_MS_TICKS)
+
+/**
+ * Swap the LED banks, if asked to, and the time has arrived (accounting for
+ * rollover). Must be called before sending the first PWM step of a cycle.
+ *
+ * @param step  Current value of SYSTICK_STEP.
+ */
+static inline void
+systick_swap(unsigned int step)
+{
+    if (SYSTICK_SWAP_WAIT &&
+        SYSTICK_SWAP_NEXT <= step &&
+        (step - SYSTICK_SWAP_NEXT < SYSTICK_SWAP_LAG)) {
+        /* Swap the LED banks */
+        leds_swap();
+        prof_swap(step - SYSTICK_SWAP_NEXT);
+        SYSTICK_SWAP_LAST = step;
+        SYSTICK_SWAP_WAIT = false;
+    }
+}
+
+#ifdef OVERLOAD_SKIP
+/* Maximum number of late animation steps to drop in a row */
+#define OVERLOAD_SKIP_MAX   8
+#endif
+
+/* Number of ticks per PWM cycle, two per PWM time unit */
+#define SYSTICK_CYCLE_TICKS (LEDS_PL_MAX * 2)
+
+/**
+ * Check if a swap scheduled for a tick is late (accounting for rollover),
+ * as of the last tick: can't happen at the start of the PWM cycle it would
+ * have, if requested in time, as its scheduled tick is a cycle behind.
+ * Swaps scheduled less than a cycle after the last one can't happen before
+ * the cycle after it anyway, so they're only late if that one is missed.
+ *
+ * @param next  The tick the swap is scheduled for.
+ *
+ * @return True if the swap is late, false otherwise.
+ */
+static inline bool
+systick_swap_late(unsigned int next)
+{
+    unsigned int earliest = SYSTICK_SWAP_LAST + SYSTICK_CYCLE_TICKS;
+    unsigned int lag;
+
+    if ((int)(earliest - next) > 0) {
+        next = earliest;
+    }
+    lag = SYSTICK_STEP - next;
+    return lag >= SYSTICK_CYCLE_TICKS && lag < SYSTICK_SWAP_LAG;
+}
+
+#if SYSTICK_MS_TICKS != ANIM_MS_TICKS
+/*
+ * Remainder of the last animation delay converted to SYSTICK_STEP ticks,
+ * in 1/ANIM_MS_TICKS of a tick
+ */
+static unsigned int SYSTICK_ANIM_REM = 0;
+#endif
+
+/**
+ * Convert an animation delay to SYSTICK_STEP ticks. If the tick rate is
+ * lowered for a long driver chain, the remainder is carried over to the
+ * next conversion, so the rounding doesn't accumulate.
+ *
+ * @param delay The delay, animation ticks.
+ *
+ * @return The delay, SYSTICK_STEP ticks.
+ */
+static inline unsigned int
+systick_anim_ticks(unsigned int delay)
+{
+#if SYSTICK_MS_TICKS == ANIM_MS_TICKS
+    return delay;
+#else
+    unsigned int part = delay % ANIM_MS_TICKS * SYSTICK_MS_TICKS +
+                        SYSTICK_ANIM_REM;
+    SYSTICK_ANIM_REM = part % ANIM_MS_TICKS;
+    return delay / ANIM_MS_TICKS * SYSTICK_MS_TICKS + part / ANIM_MS_TICKS;
+#endif
+}
+
+#if defined(TICKLESS)
+
+#if defined(LEDS_BCM) || defined(LEDS_DMA)
+#error "Tickless PWM supports linear PWM without DMA only"
+#endif
+
+/* Value of SYSTICK_STEP at the start of the current PWM cycle */
+static volatile unsigned int SYSTICK_CYCLE = 0;
+
+/**
+ * TIM2 handler, firing on compare match at the start of the PWM steps
+ * which differ from their previous steps. TIM2 counts the ticks of the
+ * PWM cycle, and the handler sets the compare value to the next changed
+ * step, or to the start of the next cycle. Loading the step right after
+ * sending it delays the whole output by one tick, which doesn't matter.
+ */
+void tim2_handler(void) __attribute__ ((isr));
+void
+tim2_handler(void)
+{
+    volatile struct tim *tim = TIM2;
+    unsigned int pwm_step = tim->ccr1 / 2;
+    unsigned int step;
+    size_t next_pwm_step;
+
+    prof_tick_start();
+
+    /* Acknowledge the interrupt */
+    tim->sr = ~TIM_SR_CC1IF_MASK;
+
+    /* Calculate the current tick value */
+    if (pwm_step == 0) {
+        SYSTICK_CYCLE += SYSTICK_CYCLE_TICKS;
+    }
+    step = SYSTICK_CYCLE + pwm_step * 2;
+    SYSTICK_STEP = step;
+
+    /* If we're on the new PWM cycle, swap banks, if it's time */
+    if (pwm_step == 0) {
+        leds_cycle();
+        systick_swap(step);
+    }
+    leds_step_send(pwm_step);
+    leds_step_flush();
+    leds_step_load();
+
+    /* Wake up at the next changed step, or at the next cycle */
+    next_pwm_step = leds_step_changed_next(pwm_step);
+    tim->ccr1 = next_pwm_step < LEDS_STEP_NUM ? next_pwm_step * 2 : 0;
+
+    prof_tick_end(false);
+}
+
+#elif defined(LEDS_BCM)
+
+/* Number of HCLK cycles per PWM time unit (two ticks) */
+#define SYSTICK_UNIT_CYCLES (SYSTICK_TICK_CYCLES * 2)
+
+/* PWM step being output (loaded by the last interrupt) */
+static volatile unsigned int SYSTICK_PWM_STEP = LEDS_STEP_NUM - 1;
+
+/**
+ * Systick handler, firing at the start of each (weighted) PWM step slot.
+ * Loads the step sent during the previous slot, sends the next one, and
+ * sets the length of the next slot.
+ */
 void systick_handler(void) __attribute__ ((isr));
 void
 systick_handler(void)
 {
     /* Current tick value */
     unsigned int step = SYSTICK_STEP;
-    unsigned int pwm_step = (step >> 1) & LEDS_BR_MAX;
+    unsigned int pwm_step = SYSTICK_PWM_STEP;
+    unsigned int next_pwm_step = pwm_step + 1 < LEDS_STEP_NUM
+                                    ? pwm_step + 1 : 0;
+
+    prof_tick_start();
+
+    /* Load the step, if it was sent */
+    if (leds_step_changed(pwm_step)) {
+        leds_step_load();
+    }
+    if (next_pwm_step == 0) {
+        leds_cycle();
+        systick_swap(step);
+    }
+    /* Send the next step, unless it's the same */
+    if (leds_step_changed(next_pwm_step)) {
+        leds_step_send(next_pwm_step);
+    }
+
+    /*
+     * The counter has already reloaded for the current slot, so this sets
+     * the length of the next one.
+     */
+    STK->load = LEDS_STEP_LEN(next_pwm_step) * SYSTICK_UNIT_CYCLES - 1;
+
+    SYSTICK_PWM_STEP = next_pwm_step;
+    SYSTICK_STEP = step + LEDS_STEP_LEN(pwm_step) * 2;
+
+    /* Every tick both loads and sends */
+    prof_tick_end(false);
+}
+
+#else
+
+/*
+ * Maximum number of PWM cycles the handler can be parked for, with the
+ * SysTick period fitting the 24-bit counter.
+ */
+#define SYSTICK_PARK_CYCLES_MAX \
+    ((1u << 24) / (SYSTICK_TICK_CYCLES * SYSTICK_CYCLE_TICKS))
+
+/*
+ * Number of ticks the SysTick period started by the last interrupt spans:
+ * one, or more, if the handler is parked.
+ */
+static volatile unsigned int SYSTICK_PERIOD_TICKS = 1;
+
+/**
+ * Get the number of PWM cycles to park the handler for, at the start of a
+ * cycle: until the cycle the banks are to be swapped at, if the swap is
+ * scheduled, or just this one cycle otherwise.
+ *
+ * @param step  Current value of SYSTICK_STEP.
+ *
+ * @return The number of cycles.
+ */
+static inline unsigned int
+systick_park_cycles(unsigned int step)
+{
+    unsigned int lag = SYSTICK_SWAP_NEXT - step;
+    unsigned int cycles;
+
+    if (!SYSTICK_SWAP_WAIT || lag >= SYSTICK_SWAP_LAG) {
+        return 1;
+    }
+    cycles = (lag + SYSTICK_CYCLE_TICKS - 1) / SYSTICK_CYCLE_TICKS;
+    return cycles < SYSTICK_PARK_CYCLES_MAX ? cycles
+                                            : SYSTICK_PARK_CYCLES_MAX;
+}
+
+/**
+ * Systick handler. If the bank being output is static, once its first
+ * step is loaded, the handler parks: the SysTick period stretches to the
+ * start of the PWM cycle the banks are to be swapped at, so the core
+ * sleeps throughout, while the drivers hold the output.
+ */
+void systick_handler(void) __attribute__ ((isr));
+void
+systick_handler(void)
+{
+    /* Current tick value */
+    unsigned int step = SYSTICK_STEP;
+    unsigned int pwm_step = (step >> 1) & (LEDS_STEP_NUM - 1);
+    /* Number of ticks the current and the next SysTick periods span */
+    unsigned int ticks = SYSTICK_PERIOD_TICKS;
+    unsigned int next_ticks = 1;
+
+    prof_tick_start();
 
     /* If it's the odd tick */
     if (step & 1) {
-        leds_step_load();
+        /* Load the step, if it was sent */
+        if (leds_step_changed(pwm_step)) {
+            leds_step_load();
+        }
     } else {
-        /*
-         * If we're on the new PWM cycle, and we are asked to swap the LED PWM
-         * data banks, and the time has arrived (accounting for rollover).
-         */
-        if (pwm_step == 0 &&
-            SYSTICK_SWAP_WAIT &&
-            SYSTICK_SWAP_NEXT <= SYSTICK_STEP &&
-            (SYSTICK_STEP - SYSTICK_SWAP_NEXT < SYSTICK_SWAP_LAG)) {
-            /* Swap the LED banks */
-            leds_swap();
-            SYSTICK_SWAP_LAST = step;
-            SYSTICK_SWAP_WAIT = false;
+        /* If we're on the new PWM cycle, swap banks, if it's time */
+        if (pwm_step == 0) {
+            leds_cycle();
+            systick_swap(step);
+            /* Park after loading the first step, if nothing changes */
+            if (leds_static()) {
+                next_ticks = systick_park_cycles(step) *
+                             SYSTICK_CYCLE_TICKS - 1;
+            }
         }
-        leds_step_send(pwm_step);
+        /* Send the step, unless it's the same as the previous one */
+        if (leds_step_changed(pwm_step)) {
+            leds_step_send(pwm_step);
+        }
+    }
+
+    /*
+     * The counter has already reloaded for the current period, so this
+     * sets the length of the next one.
+     */
+    if (next_ticks != ticks) {
+        STK->load = next_ticks * SYSTICK_TICK_CYCLES - 1;
     }
+    SYSTICK_PERIOD_TICKS = next_ticks;
+    SYSTICK_STEP = step + ticks;
 
-    SYSTICK_STEP++;
+    prof_tick_end(step & 1);
 }
 
+#endif
+
+#ifdef LEDS_DMA
+/** LED step transfer completion handler */
+void dma1_channel3_handler(void) __attribute__ ((isr));
+void
+dma1_channel3_handler(void)
+{
+    leds_step_done();
+}
+#endif
+
 /**
  * Seed the PRNG from successive ADC readings of the internal temperature
  * sensor.
@@ -143,15 +448,31 @@ main(void)
     /* Basic init */
     init();
 
+    /* Paint the stacks, and move interrupts to their own */
+    stack_init();
+
+    /* Enable cycle counting */
+    prof_init();
+
     /*
      * Enable clocks
      */
     /* Enable APB2 clock to I/O port A and SPI1 */
     RCC->apb2enr |= RCC_APB2ENR_IOPAEN_MASK | RCC_APB2ENR_IOPCEN_MASK | RCC_APB2ENR_SPI1EN_MASK;
+#ifdef LEDS_DMA
+    /* Enable AHB clock to DMA1, feeding the SPI */
+    RCC->ahbenr |= RCC_AHBENR_DMA1EN_MASK;
+#endif
 
     /*
      * Configure pins
      */
+#ifdef LEDS_GAIN
+    /* A3 - GPIO - OE(ED2), push-pull output, outputs enabled */
+    gpio_pin_set(GPIO_A, 3, false);
+    gpio_pin_conf(GPIO_A, 3,
+                  GPIO_MODE_OUTPUT_2MHZ, GPIO_CNF_OUTPUT_GP_PUSH_PULL);
+#endif
     /* A4 - GPIO - LE(ED1), push-pull output */
     gpio_pin_set(GPIO_A, 4, false);
     gpio_pin_conf(GPIO_A, 4,
@@ -181,6 +502,15 @@ main(void)
 
     /* Initialize LED states */
     leds_init(SPI, GPIO_A, 4);
+#ifdef LEDS_GAIN
+    /* Program the driver current gain with the first loaded step */
+    leds_gain_init(GPIO_A, 5, 3);
+    leds_gain_set(LEDS_GAIN);
+#endif
+#ifdef LEDS_DMA
+    /* Enable the LED step transfer completion interrupt */
+    nvic_int_enable(NVIC_INT_DMA1_CHANNEL3);
+#endif
 
     /* Seed the global PRNG */
     seed_prng();
@@ -188,24 +518,97 @@ main(void)
     /* Initialize animation state */
     anim_init();
 
+#if defined(TICKLESS)
+    /*
+     * Set TIM2 to count SYSTICK_STEP ticks of the PWM cycle, from the 72MHz
+     * timer clock (APB1 clock times two), and to fire the interrupt at the
+     * start of the first cycle. The handler takes it from there.
+     */
+    RCC->apb1enr |= RCC_APB1ENR_TIM2EN_MASK;
+    TIM2->psc = SYSTICK_TICK_CYCLES - 1;
+    TIM2->arr = SYSTICK_CYCLE_TICKS - 1;
+    TIM2->ccr1 = 0;
+    TIM2->egr = TIM_EGR_UG_MASK;
+    TIM2->sr = 0;
+    TIM2->dier |= TIM_DIER_CC1IE_MASK;
+    nvic_int_enable(NVIC_INT_TIM2);
+    TIM2->cr1 |= TIM_CR1_CEN_MASK;
+#else
+#ifdef LEDS_BCM
+    /*
+     * Set SysTick timer to fire the interrupt at the end of the last PWM
+     * step slot, setting the unit to HCLK (72MHz). The handler takes it
+     * from there, with slots adding up to PWM frequency of 375 Hz, or less
+     * for long driver chains.
+     */
+    STK->val = STK->load =
+        LEDS_STEP_LEN(LEDS_STEP_NUM - 1) * SYSTICK_UNIT_CYCLES - 1;
+#else
     /*
      * Set SysTick timer to fire the interrupt at frequency 375 * 64 * 2 =
-     * 48KHz, setting the unit to HCLK (72MHz). This way we can have PWM
-     * frequency of 375 Hz, 64 pulse lengths, and also trigger Load-Enable
-     * every other pulse.
+     * 48KHz (or less for long driver chains), setting the unit to HCLK
+     * (72MHz). This way we can have PWM frequency of 375 Hz, 64 pulse
+     * lengths, and also trigger Load-Enable every other pulse.
      */
-    STK->val = STK->load = 72000000 / 375 / 64 / 2 - 1;
+    STK->val = STK->load = SYSTICK_TICK_CYCLES - 1;
+#endif
     STK->ctrl |= STK_CTRL_ENABLE_MASK | STK_CTRL_TICKINT_MASK |
                  (STK_CTRL_CLKSOURCE_VAL_AHB << STK_CTRL_CLKSOURCE_LSB);
+#endif
 
     {
         unsigned int delay;
+        unsigned int next;
+#ifdef OVERLOAD_SKIP
+        unsigned int dropped;
+#endif
         while (true) {
             while (SYSTICK_SWAP_WAIT) {
-                asm ("wfi");
+                WFI();
+            }
+            prof_render_start();
+            delay = anim_advance();
+#if defined(OVERLOAD_SKIP)
+            /*
+             * Keep to the schedule, dropping the steps already late, but
+             * not too many in a row, in case rendering can't keep up
+             */
+            next = SYSTICK_SWAP_NEXT + systick_anim_ticks(delay);
+            for (dropped = 0;
+                 dropped < OVERLOAD_SKIP_MAX && systick_swap_late(next);
+                 dropped++) {
+                delay = anim_advance();
+                next += systick_anim_ticks(delay);
+            }
+#elif defined(OVERLOAD_CATCHUP)
+            /*
+             * Keep to the schedule, advancing through the steps already
+             * late, however many
+             */
+            next = SYSTICK_SWAP_NEXT + systick_anim_ticks(delay);
+            while (systick_swap_late(next)) {
+                delay = anim_advance();
+                next += systick_anim_ticks(delay);
+            }
+#else
+            /*
+             * Stretch the schedule, counting from the last swap, if the
+             * step is already late. Otherwise count from the tick the last
+             * swap was scheduled for, so swaps rounded to the PWM cycle
+             * start don't accumulate delay.
+             */
+            next = SYSTICK_SWAP_NEXT + systick_anim_ticks(delay);
+            if (systick_swap_late(next)) {
+                next = SYSTICK_SWAP_LAST + systick_anim_ticks(delay);
             }
-            delay = anim_step();
-            SYSTICK_SWAP_NEXT = SYSTICK_SWAP_LAST + delay * 48;
+#endif
+            /*
+             * Render the step to swap in, along with whatever the dropped
+             * steps changed
+             */
+            anim_render();
+            SYSTICK_SWAP_NEXT = next;
+            prof_render_end(systick_swap_late(next));
             SYSTICK_SWAP_WAIT = true;
         }
     }
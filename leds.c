@@ -69,6 +69,12 @@
  */
 
 #include "leds.h"
+#ifdef LEDS_DMA
+#include <dma.h>
+#endif
+#ifdef HOST
+#include <sim.h>
+#endif
 #include <misc.h>
 #include <stdbool.h>
 
@@ -81,6 +87,99 @@ static volatile struct gpio *LEDS_LE_GPIO;
 /** The GPIO pin controlling the load-enable (LE) pin */
 static unsigned int LEDS_LE_PIN;
 
+#ifdef LEDS_DMA
+/** DMA controller channel feeding the SPI transmit buffer (SPI1_TX) */
+#define LEDS_DMA_CH     3
+/** DMA channel registers feeding the SPI transmit buffer */
+static volatile struct dma_ch *const LEDS_DMA_CH_REGS =
+                                        &DMA1->ch[LEDS_DMA_CH - 1];
+#endif
+
+#ifdef LEDS_GAIN
+/** The GPIO peripheral with the CLK and the output-enable (OE) pins */
+static volatile struct gpio *LEDS_GAIN_GPIO;
+
+/** The GPIO pin outputting the SPI clock to CLK */
+static unsigned int LEDS_GAIN_CLK_PIN;
+
+/** The GPIO pin controlling the output-enable (OE) pin */
+static unsigned int LEDS_GAIN_OE_PIN;
+
+/** Configuration code to program into the drivers */
+static volatile uint8_t LEDS_GAIN_CODE_NEXT;
+
+/** True if LEDS_GAIN_CODE_NEXT has to be programmed */
+static volatile bool LEDS_GAIN_PENDING = false;
+#endif
+
+#ifdef LEDS_DITHER
+
+/**
+ * Number of dithering phases: PWM cycles in the dithering pattern, and
+ * fractions of a pulse length step which LEDS_BR_PL resolves.
+ */
+#define LEDS_DITHER_PHASES  4
+
+/**
+ * Fractional pulse length offset of each dithering phase, arranged so the
+ * extra steps of a fractional pulse length are spread evenly over the
+ * cycles.
+ */
+static const uint8_t LEDS_DITHER_OFF[LEDS_DITHER_PHASES] = {0, 2, 1, 3};
+
+/** Dithering phase of the active PWM bank being output */
+static volatile size_t LEDS_DITHER_PHASE = 0;
+
+/**
+ * Brightness value to pulse length map, in fractions of a step.
+ * Generated with
+ * perl -e 'for (my $i=0; $i < 256; $i++) {
+ *              my $q = int(256*(2**(5.8*$i/255)-1)/(2**5.8-1)+0.5);
+ *              $q = 1 if $q == 0 && $i > 0;
+ *              printf("0x%03x, ", $q);
+ *          };
+ *          print("\n")'
+ */
+static const uint16_t LEDS_BR_PL[LEDS_BR_NUM] = {
+    0x000, 0x001, 0x001, 0x001, 0x001, 0x001, 0x001, 0x001,
+    0x001, 0x001, 0x001, 0x001, 0x001, 0x001, 0x001, 0x001,
+    0x001, 0x001, 0x002, 0x002, 0x002, 0x002, 0x002, 0x002,
+    0x002, 0x002, 0x002, 0x002, 0x003, 0x003, 0x003, 0x003,
+    0x003, 0x003, 0x003, 0x003, 0x004, 0x004, 0x004, 0x004,
+    0x004, 0x004, 0x004, 0x005, 0x005, 0x005, 0x005, 0x005,
+    0x005, 0x005, 0x006, 0x006, 0x006, 0x006, 0x006, 0x006,
+    0x007, 0x007, 0x007, 0x007, 0x007, 0x008, 0x008, 0x008,
+    0x008, 0x008, 0x009, 0x009, 0x009, 0x009, 0x009, 0x00a,
+    0x00a, 0x00a, 0x00a, 0x00b, 0x00b, 0x00b, 0x00b, 0x00c,
+    0x00c, 0x00c, 0x00c, 0x00d, 0x00d, 0x00d, 0x00d, 0x00e,
+    0x00e, 0x00e, 0x00f, 0x00f, 0x00f, 0x010, 0x010, 0x010,
+    0x011, 0x011, 0x011, 0x012, 0x012, 0x012, 0x013, 0x013,
+    0x013, 0x014, 0x014, 0x015, 0x015, 0x015, 0x016, 0x016,
+    0x017, 0x017, 0x018, 0x018, 0x018, 0x019, 0x019, 0x01a,
+    0x01a, 0x01b, 0x01b, 0x01c, 0x01c, 0x01d, 0x01d, 0x01e,
+    0x01f, 0x01f, 0x020, 0x020, 0x021, 0x021, 0x022, 0x023,
+    0x023, 0x024, 0x025, 0x025, 0x026, 0x027, 0x027, 0x028,
+    0x029, 0x029, 0x02a, 0x02b, 0x02c, 0x02c, 0x02d, 0x02e,
+    0x02f, 0x030, 0x030, 0x031, 0x032, 0x033, 0x034, 0x035,
+    0x036, 0x037, 0x037, 0x038, 0x039, 0x03a, 0x03b, 0x03c,
+    0x03d, 0x03f, 0x040, 0x041, 0x042, 0x043, 0x044, 0x045,
+    0x046, 0x048, 0x049, 0x04a, 0x04b, 0x04c, 0x04e, 0x04f,
+    0x050, 0x052, 0x053, 0x055, 0x056, 0x057, 0x059, 0x05a,
+    0x05c, 0x05d, 0x05f, 0x061, 0x062, 0x064, 0x065, 0x067,
+    0x069, 0x06b, 0x06c, 0x06e, 0x070, 0x072, 0x074, 0x076,
+    0x078, 0x07a, 0x07c, 0x07e, 0x080, 0x082, 0x084, 0x086,
+    0x088, 0x08b, 0x08d, 0x08f, 0x091, 0x094, 0x096, 0x099,
+    0x09b, 0x09e, 0x0a0, 0x0a3, 0x0a6, 0x0a8, 0x0ab, 0x0ae,
+    0x0b1, 0x0b4, 0x0b7, 0x0ba, 0x0bd, 0x0c0, 0x0c3, 0x0c6,
+    0x0c9, 0x0cc, 0x0d0, 0x0d3, 0x0d6, 0x0da, 0x0de, 0x0e1,
+    0x0e5, 0x0e8, 0x0ec, 0x0f0, 0x0f4, 0x0f8, 0x0fc, 0x100
+};
+
+#else
+
+/** Number of dithering phases: no dithering */
+#define LEDS_DITHER_PHASES  1
+
 /** Brightness value to pulse length map */
 static const uint8_t LEDS_BR_PL[LEDS_BR_NUM] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
@@ -93,32 +192,135 @@ static const uint8_t LEDS_BR_PL[LEDS_BR_NUM] = {
     0x28, 0x2b, 0x2e, 0x31, 0x34, 0x38, 0x3c, 0x40
 };
 
+#endif
+
+/**
+ * Get the pulse length of a brightness value, at a dithering phase.
+ *
+ * @param br    The brightness value.
+ * @param phase The dithering phase.
+ *
+ * @return The pulse length.
+ */
+static inline uint8_t
+leds_br_pl(uint8_t br, size_t phase)
+{
+#ifdef LEDS_DITHER
+    return (LEDS_BR_PL[br] + LEDS_DITHER_OFF[phase]) / LEDS_DITHER_PHASES;
+#else
+    (void)phase;
+    return LEDS_BR_PL[br];
+#endif
+}
+
+#ifdef LEDS_BCM
+/**
+ * Check if an LED is on at a bit-plane PWM step.
+ *
+ * @param pl    The LED pulse length.
+ * @param step  The PWM step.
+ *
+ * @return True if the LED is on, false otherwise.
+ */
+static inline bool
+leds_step_on(uint8_t pl, size_t step)
+{
+    /* Full pulse sets all planes, including the last, remainder plane */
+    return pl == LEDS_PL_MAX || ((pl >> step) & 1);
+}
+#endif
+
 /** Brightness value of each LED */
 uint8_t LEDS_BR[LEDS_NUM] = {0, };
 
-/** State of each LED for each PWM step, in two banks */
-static volatile uint8_t LEDS_PWM_BANKS[2][LEDS_BR_NUM][LEDS_NUM / 8] =
+/**
+ * Number of PWM banks: two, double-buffered, each with one sub-bank per
+ * dithering phase, indexed by LEDS_PWM_SUB().
+ */
+#define LEDS_PWM_SUB_NUM    (2 * LEDS_DITHER_PHASES)
+
+/**
+ * Get the index of a PWM bank's sub-bank.
+ *
+ * @param _bank     The bank index, zero or one.
+ * @param _phase    The dithering phase.
+ */
+#define LEDS_PWM_SUB(_bank, _phase) ((_bank) * LEDS_DITHER_PHASES + (_phase))
+
+/** State of each LED for each PWM step, in two banks of sub-banks */
+static volatile uint8_t LEDS_PWM_BANKS[LEDS_PWM_SUB_NUM]
+                                      [LEDS_STEP_NUM][LEDS_NUM / 8] =
                                                                 {{{0, }}};
 
+/** Pulse lengths of all LEDs */
+union leds_pl {
+    /** Pulse length of each LED */
+    uint8_t     led[LEDS_NUM];
+    /**
+     * Pulse lengths of each four LEDs, lowest-numbered LED in the lowest
+     * byte, as both Cortex-M3 and the usual hosts are little-endian.
+     */
+    uint32_t    word[LEDS_NUM / 4];
+};
+
+/**
+ * Pulse length of each LED, as rendered into each PWM bank, used to skip
+ * rendering LEDs which haven't changed since the bank was last rendered.
+ */
+static union leds_pl LEDS_PWM_BANKS_PL[LEDS_PWM_SUB_NUM];
+
+/**
+ * Masks of PWM steps which differ from the previous step, one per bank.
+ * Step zero is always included, as it follows the last step of the
+ * previous cycle, possibly output from the other bank.
+ */
+static volatile uint64_t LEDS_PWM_BANKS_CHANGED[LEDS_PWM_SUB_NUM] = {
+    [0 ... LEDS_PWM_SUB_NUM - 1] = 1
+};
+
+/** True for each PWM bank rendered since its changed step mask was built */
+static bool LEDS_PWM_BANKS_STALE[LEDS_PWM_SUB_NUM] = {false, };
+
+/**
+ * True for each of the two PWM banks which steps are all the same, in all
+ * sub-banks. The initial, dark banks are.
+ */
+static volatile bool LEDS_PWM_BANKS_STATIC[2] = {true, true};
+
 /** Index of the PWM LED state bank currently being output */
 static volatile size_t LEDS_PWM_BANK = 0;
 
-const uint8_t LEDS_STARS_LIST[LEDS_STARS_NUM] = {
+/**
+ * Get the index of the sub-bank currently being output.
+ *
+ * @return The sub-bank index.
+ */
+static inline size_t
+leds_pwm_sub_active(void)
+{
+#ifdef LEDS_DITHER
+    return LEDS_PWM_SUB(LEDS_PWM_BANK, LEDS_DITHER_PHASE);
+#else
+    return LEDS_PWM_BANK;
+#endif
+}
+
+const leds_idx LEDS_STARS_LIST[LEDS_STARS_NUM] = {
     19, 17, 16, 27, 18, 26, 25, 31, 15,
     20, 24, 29, 30, 21, 28, 22, 7, 23
 };
 
-const uint8_t LEDS_TOPPER_LIST[LEDS_TOPPER_NUM] = {
+const leds_idx LEDS_TOPPER_LIST[LEDS_TOPPER_NUM] = {
     32
 };
 
-const uint8_t LEDS_BALLS_LIST[LEDS_BALLS_NUM] = {
+const leds_idx LEDS_BALLS_LIST[LEDS_BALLS_NUM] = {
     6, 33, 13, 5, 34, 14, 12, 4, 3, 36,
     11, 10, 37, 2, 38, 9, 39, 0, 35, 8, 1
 };
 
-const uint8_t LEDS_BALLS_SWNE_LINE_LIST[LEDS_BALLS_SWNE_LINE_NUM]
-                                       [LEDS_BALLS_SWNE_LINE_LEN] = {
+const leds_idx LEDS_BALLS_SWNE_LINE_LIST[LEDS_BALLS_SWNE_LINE_NUM]
+                                        [LEDS_BALLS_SWNE_LINE_LEN] = {
 #define LINE(_leds...) {_leds, LEDS_IDX_INVALID}
     LINE(33, 6),
     LINE(5, 13),
@@ -130,7 +332,7 @@ const uint8_t LEDS_BALLS_SWNE_LINE_LIST[LEDS_BALLS_SWNE_LINE_NUM]
 #undef LINE
 };
 
-const uint8_t LEDS_BALLS_ROW_LIST[LEDS_BALLS_ROW_NUM][LEDS_BALLS_COL_NUM] = {
+const leds_idx LEDS_BALLS_ROW_LIST[LEDS_BALLS_ROW_NUM][LEDS_BALLS_COL_NUM] = {
 #define X LEDS_IDX_INVALID
     {   X,  X,  X,  6,  X   },
     {   X,  X, 33,  X,  X   },
@@ -146,8 +348,8 @@ const uint8_t LEDS_BALLS_ROW_LIST[LEDS_BALLS_ROW_NUM][LEDS_BALLS_COL_NUM] = {
 #undef X
 };
 
-const uint8_t LEDS_BALLS_COLOR_LIST[LEDS_BALLS_COLOR_NUM]
-                                   [LEDS_BALLS_COLOR_LEN] = {
+const leds_idx LEDS_BALLS_COLOR_LIST[LEDS_BALLS_COLOR_NUM]
+                                    [LEDS_BALLS_COLOR_LEN] = {
     [LEDS_BALLS_COLOR_RED]      = {6, 5, 4, 3, 2, 1, 0},
     [LEDS_BALLS_COLOR_GREEN]    = {13, 14, 12, 11, 10, 9, 8},
     [LEDS_BALLS_COLOR_YELLOW]   = {33, 34, 36, 37, 39, 38, 35},
@@ -162,45 +364,174 @@ leds_init(volatile struct spi *spi,
     LEDS_SPI = spi;
     LEDS_LE_GPIO = le_gpio;
     LEDS_LE_PIN = le_pin;
+
+#ifdef LEDS_DMA
+    /*
+     * Configure the DMA channel to write bytes from memory to the SPI
+     * data register, incrementing the memory address, and to signal
+     * transfer completion.
+     */
+    LEDS_DMA_CH_REGS->ccr = 0;
+    LEDS_DMA_CH_REGS->cpar = (uintptr_t)&spi->dr;
+    LEDS_DMA_CH_REGS->ccr = DMA_CCR_DIR_MASK | DMA_CCR_MINC_MASK |
+                            DMA_CCR_TCIE_MASK |
+                            (DMA_CCR_SIZE_VAL_8BIT << DMA_CCR_PSIZE_LSB) |
+                            (DMA_CCR_SIZE_VAL_8BIT << DMA_CCR_MSIZE_LSB) |
+                            (DMA_CCR_PL_VAL_HIGH << DMA_CCR_PL_LSB);
+    /* Let SPI request data from DMA when its transmit buffer is empty */
+    spi->cr2 |= SPI_CR2_TXDMAEN_MASK;
+#endif
 }
 
-void
-leds_render(void)
+#if defined(LEDS_RENDER_EDGE)
+
+#ifdef LEDS_BCM
+#error "Edge-based render kernel requires linear PWM"
+#endif
+
+/**
+ * Render PWM steps of the masked LEDs into a bank, from the pulse lengths
+ * in LEDS_PWM_BANKS_PL. Edge-based kernel: sorts the LEDs by pulse length
+ * and builds the steps from the last one down, turning the LEDs on as
+ * their pulses start covering the step.
+ *
+ * @param bank  Index of the bank to render into.
+ * @param mask  Masks of LEDs to render, one per LED state byte.
+ */
+static void
+leds_render_mask(size_t bank, const uint8_t *mask)
 {
-    /* Use inactive bank */
-    size_t bank = !LEDS_PWM_BANK;
-    uint8_t step;
-    size_t i;
+    const uint8_t *pl = LEDS_PWM_BANKS_PL[bank].led;
+    /* Masked LED indexes, by descending pulse length */
+    leds_idx order[LEDS_NUM];
+    /* Masks of LEDs on at the current step */
+    uint8_t on[LEDS_NUM / 8] = {0, };
+    size_t num = 0;
+    size_t led_idx, step, i, j;
+
+    /* Insertion-sort the masked LEDs */
+    for (led_idx = 0; led_idx < LEDS_NUM; led_idx++) {
+        if (!(mask[led_idx >> 3] & (1 << (led_idx & 0x7)))) {
+            continue;
+        }
+        for (j = num; j > 0 && pl[order[j - 1]] < pl[led_idx]; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = led_idx;
+        num++;
+    }
+
+    /* For each PWM step, from the last one */
+    i = 0;
+    step = ARRAY_SIZE(LEDS_PWM_BANKS[bank]);
+    while (step-- > 0) {
+        /* Turn on LEDs with pulses reaching this step */
+        for (; i < num && pl[order[i]] > step; i++) {
+            on[order[i] >> 3] |= 1 << (order[i] & 0x7);
+        }
+        /* Output the masked bits */
+        for (j = 0; j < ARRAY_SIZE(on); j++) {
+            if (mask[j] != 0) {
+                LEDS_PWM_BANKS[bank][step][j] =
+                    (LEDS_PWM_BANKS[bank][step][j] & ~mask[j]) | on[j];
+            }
+        }
+    }
+}
+
+#elif defined(LEDS_RENDER_SWAR)
+
+/**
+ * Check if each of four LEDs is on at a PWM step, with the pulse lengths
+ * packed into byte lanes of a word.
+ *
+ * @param word  The word with LED pulse lengths.
+ * @param step  The PWM step.
+ *
+ * @return Mask of four LEDs, on at the step.
+ */
+static inline uint8_t
+leds_swar_step_on(uint32_t word, size_t step)
+{
+#ifdef LEDS_BCM
+    /* Get the step bit, or the full pulse bit, into bit 0 of each lane */
+    word = ((word >> step) | (word >> (LEDS_STEP_NUM - 1))) & 0x01010101;
+#else
+    /*
+     * Add 127 - step to each lane, so bit 7 gets set if the pulse length
+     * is greater than the step. Pulse lengths never exceed 64, so the
+     * lanes don't carry into each other.
+     */
+    word = ((word + (0x7f - step) * 0x01010101) >> 7) & 0x01010101;
+#endif
+    /* Gather bit 0 of each lane into bits 24-27 */
+    return (word * 0x01020408) >> 24;
+}
+
+/**
+ * Render PWM steps of the masked LEDs into a bank, from the pulse lengths
+ * in LEDS_PWM_BANKS_PL. SWAR kernel: compares pulse lengths of four LEDs
+ * with each step at once, in byte lanes of a word.
+ *
+ * @param bank  Index of the bank to render into.
+ * @param mask  Masks of LEDs to render, one per LED state byte.
+ */
+static void
+leds_render_mask(size_t bank, const uint8_t *mask)
+{
+    const uint32_t *word = LEDS_PWM_BANKS_PL[bank].word;
+    size_t step, i;
+    uint8_t on;
 
     /* For each PWM step */
     for (step = 0; step < ARRAY_SIZE(LEDS_PWM_BANKS[bank]); step++) {
-        /* Zero the step */
+        /* For each LED state byte with masked bits */
         for (i = 0; i < ARRAY_SIZE(LEDS_PWM_BANKS[bank][step]); i++) {
-            LEDS_PWM_BANKS[bank][step][i] = 0;
-        }
-        /* Render the step */
-        for (i = 0; i < ARRAY_SIZE(LEDS_BR); i++) {
-            LEDS_PWM_BANKS[bank][step][i >> 3] |=
-                (LEDS_BR_PL[LEDS_BR[i]] > step) << (i & 0x7);
+            if (mask[i] == 0) {
+                continue;
+            }
+            on = leds_swar_step_on(word[i * 2], step) |
+                 (leds_swar_step_on(word[i * 2 + 1], step) << 4);
+            LEDS_PWM_BANKS[bank][step][i] =
+                (LEDS_PWM_BANKS[bank][step][i] & ~mask[i]) | (on & mask[i]);
         }
     }
 }
 
-void
-leds_render_list(const uint8_t *led_list, size_t led_num)
+#else
+
+/**
+ * Render PWM steps of the masked LEDs into a bank, from the pulse lengths
+ * in LEDS_PWM_BANKS_PL. Bit kernel: renders one LED at a time.
+ *
+ * @param bank  Index of the bank to render into.
+ * @param mask  Masks of LEDs to render, one per LED state byte.
+ */
+static void
+leds_render_mask(size_t bank, const uint8_t *mask)
 {
-    /* Use inactive bank */
-    size_t bank = !LEDS_PWM_BANK;
-    size_t led_list_idx, led_idx, led_pl, led_byte, step;
+    size_t led_idx, led_pl, led_byte, step;
     uint8_t led_mask, led_not_mask;
 
-    /* For each LED in the list */
-    for (led_list_idx = 0; led_list_idx < led_num; led_list_idx++) {
-        led_idx = led_list[led_list_idx];
-        led_pl = LEDS_BR_PL[LEDS_BR[led_idx]];
+    /* For each masked LED */
+    for (led_idx = 0; led_idx < LEDS_NUM; led_idx++) {
         led_byte = led_idx >> 3;
         led_mask = 1 << (led_idx & 0x7);
+        if (!(mask[led_byte] & led_mask)) {
+            continue;
+        }
+        led_pl = LEDS_PWM_BANKS_PL[bank].led[led_idx];
         led_not_mask = ~led_mask;
+#ifdef LEDS_BCM
+        /* Set or clear the bit in each plane */
+        for (step = 0; step < ARRAY_SIZE(LEDS_PWM_BANKS[bank]); step++) {
+            if (leds_step_on(led_pl, step)) {
+                LEDS_PWM_BANKS[bank][step][led_byte] |= led_mask;
+            } else {
+                LEDS_PWM_BANKS[bank][step][led_byte] &= led_not_mask;
+            }
+        }
+#else
         /* Set step bits under pulse length */
         for (step = 0; step < led_pl; step++) {
             LEDS_PWM_BANKS[bank][step][led_byte] |= led_mask;
@@ -209,25 +540,180 @@ leds_render_list(const uint8_t *led_list, size_t led_num)
         for (; step < ARRAY_SIZE(LEDS_PWM_BANKS[bank]); step++) {
             LEDS_PWM_BANKS[bank][step][led_byte] &= led_not_mask;
         }
+#endif
+    }
+}
+
+#endif
+
+void
+leds_render(void)
+{
+    size_t phase, bank;
+    uint8_t mask[LEDS_NUM / 8];
+    size_t i;
+
+    /* Render all LEDs */
+    for (i = 0; i < ARRAY_SIZE(mask); i++) {
+        mask[i] = 0xff;
+    }
+
+    /* For each sub-bank of the inactive bank */
+    for (phase = 0; phase < LEDS_DITHER_PHASES; phase++) {
+        bank = LEDS_PWM_SUB(!LEDS_PWM_BANK, phase);
+        /* Take all pulse lengths */
+        for (i = 0; i < ARRAY_SIZE(LEDS_BR); i++) {
+            LEDS_PWM_BANKS_PL[bank].led[i] = leds_br_pl(LEDS_BR[i], phase);
+        }
+        leds_render_mask(bank, mask);
+        LEDS_PWM_BANKS_STALE[bank] = true;
     }
 }
 
+void
+leds_render_list(const leds_idx *led_list, size_t led_num)
+{
+    size_t phase, bank;
+    uint8_t mask[LEDS_NUM / 8];
+    bool changed;
+    size_t led_list_idx, led_idx, led_pl, i;
+
+    /* For each sub-bank of the inactive bank */
+    for (phase = 0; phase < LEDS_DITHER_PHASES; phase++) {
+        bank = LEDS_PWM_SUB(!LEDS_PWM_BANK, phase);
+        for (i = 0; i < ARRAY_SIZE(mask); i++) {
+            mask[i] = 0;
+        }
+        changed = false;
+
+        /* For each LED in the list */
+        for (led_list_idx = 0; led_list_idx < led_num; led_list_idx++) {
+            led_idx = led_list[led_list_idx];
+            led_pl = leds_br_pl(LEDS_BR[led_idx], phase);
+            /* Skip the LED if the bank already has its pulse length */
+            if (LEDS_PWM_BANKS_PL[bank].led[led_idx] == led_pl) {
+                continue;
+            }
+            LEDS_PWM_BANKS_PL[bank].led[led_idx] = led_pl;
+            mask[led_idx >> 3] |= 1 << (led_idx & 0x7);
+            changed = true;
+        }
+
+        /* Render the changed LEDs, if any */
+        if (changed) {
+            leds_render_mask(bank, mask);
+            LEDS_PWM_BANKS_STALE[bank] = true;
+        }
+    }
+}
+
+/**
+ * Find the PWM steps of a sub-bank which differ from their previous steps,
+ * if it was rendered since the last time.
+ *
+ * @param bank  Index of the sub-bank.
+ */
+static void
+leds_render_finish_sub(size_t bank)
+{
+    uint64_t changed = 1;
+    size_t step, i;
+
+    if (!LEDS_PWM_BANKS_STALE[bank]) {
+        return;
+    }
+
+    /* For each PWM step after the first */
+    for (step = 1; step < ARRAY_SIZE(LEDS_PWM_BANKS[bank]); step++) {
+        /* Mark the step if any of its bytes differ from the previous step */
+        for (i = 0; i < ARRAY_SIZE(LEDS_PWM_BANKS[bank][step]); i++) {
+            if (LEDS_PWM_BANKS[bank][step][i] !=
+                LEDS_PWM_BANKS[bank][step - 1][i]) {
+                changed |= (uint64_t)1 << step;
+                break;
+            }
+        }
+    }
+
+    LEDS_PWM_BANKS_CHANGED[bank] = changed;
+    LEDS_PWM_BANKS_STALE[bank] = false;
+}
+
+void
+leds_render_finish(void)
+{
+    size_t phase;
+    bool still = true;
+
+    /* For each sub-bank of the inactive bank */
+    for (phase = 0; phase < LEDS_DITHER_PHASES; phase++) {
+        leds_render_finish_sub(LEDS_PWM_SUB(!LEDS_PWM_BANK, phase));
+        /* Only the first step differs from the previous cycle's last */
+        still = still &&
+            LEDS_PWM_BANKS_CHANGED[LEDS_PWM_SUB(!LEDS_PWM_BANK, phase)] == 1;
+    }
+    LEDS_PWM_BANKS_STATIC[!LEDS_PWM_BANK] = still;
+}
+
 void
 leds_swap(void)
 {
     LEDS_PWM_BANK = !LEDS_PWM_BANK;
+#ifdef HOST
+    sim_trace_swap(LEDS_BR, LEDS_NUM,
+                   LEDS_PWM_BANKS[LEDS_PWM_SUB(LEDS_PWM_BANK, 0)],
+                   sizeof(LEDS_PWM_BANKS[0]) * LEDS_DITHER_PHASES);
+#endif
+}
+
+#ifdef LEDS_DITHER
+void
+leds_cycle(void)
+{
+    LEDS_DITHER_PHASE = (LEDS_DITHER_PHASE + 1) % LEDS_DITHER_PHASES;
+}
+#endif
+
+bool
+leds_step_changed(size_t step)
+{
+    return (LEDS_PWM_BANKS_CHANGED[leds_pwm_sub_active()] >> step) & 1;
+}
+
+size_t
+leds_step_changed_next(size_t step)
+{
+    /* Shift twice, as shifting by the full width is undefined */
+    uint64_t changed =
+        LEDS_PWM_BANKS_CHANGED[leds_pwm_sub_active()] >> step >> 1;
+    return changed == 0 ? LEDS_STEP_NUM
+                        : step + 1 + (size_t)__builtin_ctzll(changed);
+}
+
+bool
+leds_static(void)
+{
+    return LEDS_PWM_BANKS_STATIC[LEDS_PWM_BANK];
 }
 
 void
 leds_step_send(size_t step)
 {
     /* Use active bank */
-    size_t bank = LEDS_PWM_BANK;
+    size_t bank = leds_pwm_sub_active();
+#ifndef LEDS_DMA
     size_t i;
+#endif
 
     /* Disable loading the data to the outputs */
     gpio_pin_set(LEDS_LE_GPIO, LEDS_LE_PIN, false);
 
+#ifdef LEDS_DMA
+    /* Point the (disabled) DMA channel at the step and start it */
+    LEDS_DMA_CH_REGS->cmar = (uintptr_t)LEDS_PWM_BANKS[bank][step];
+    LEDS_DMA_CH_REGS->cndtr = ARRAY_SIZE(LEDS_PWM_BANKS[bank][step]);
+    LEDS_DMA_CH_REGS->ccr |= DMA_CCR_EN_MASK;
+#else
     /* For each LED state byte */
     for (i = 0; i < ARRAY_SIZE(LEDS_PWM_BANKS[bank][step]); i++) {
         /* Receive and discard the last answer, if any */
@@ -240,11 +726,129 @@ leds_step_send(size_t step)
         /* Output the state byte */
         LEDS_SPI->dr = LEDS_PWM_BANKS[bank][step][i];
     }
+#endif
+}
+
+#ifdef LEDS_DMA
+void
+leds_step_done(void)
+{
+    unsigned int discard;
+
+    /* Acknowledge the transfer and disable the channel for the next one */
+    DMA1->ifcr = DMA_IFCR_CGIF_MASK(LEDS_DMA_CH) |
+                 DMA_IFCR_CTCIF_MASK(LEDS_DMA_CH) |
+                 DMA_IFCR_CHTIF_MASK(LEDS_DMA_CH) |
+                 DMA_IFCR_CTEIF_MASK(LEDS_DMA_CH);
+    LEDS_DMA_CH_REGS->ccr &= ~DMA_CCR_EN_MASK;
+
+    /*
+     * Discard the last answer, clearing the overrun flag raised by the
+     * answers nobody has read during the transfer.
+     */
+    discard = LEDS_SPI->dr;
+    discard = LEDS_SPI->sr;
+    (void)discard;
 }
+#endif
+
+#ifndef LEDS_DMA
+void
+leds_step_flush(void)
+{
+    /* Wait for the last byte to get into the shift register, and out */
+    while (!(LEDS_SPI->sr & SPI_SR_TXE_MASK));
+    while (LEDS_SPI->sr & SPI_SR_BSY_MASK);
+}
+#endif
+
+#ifdef LEDS_GAIN
+void
+leds_gain_init(volatile struct gpio *gpio,
+               unsigned int clk_pin,
+               unsigned int oe_pin)
+{
+    LEDS_GAIN_GPIO = gpio;
+    LEDS_GAIN_CLK_PIN = clk_pin;
+    LEDS_GAIN_OE_PIN = oe_pin;
+}
+
+void
+leds_gain_set(uint8_t code)
+{
+    LEDS_GAIN_CODE_NEXT = code;
+    LEDS_GAIN_PENDING = true;
+}
+
+/**
+ * Switch the drivers between normal and special mode, by clocking five
+ * pulses out of the CLK pin, switched to GPIO, with OE low during the
+ * second, and LE high during the fourth for special mode. Leaves OE high,
+ * turning the outputs off, and LE low.
+ *
+ * @param special   True to switch to special mode, false to normal mode.
+ */
+static void
+leds_gain_mode(bool special)
+{
+    size_t i;
+
+    gpio_pin_set(LEDS_GAIN_GPIO, LEDS_GAIN_CLK_PIN, false);
+    gpio_pin_conf(LEDS_GAIN_GPIO, LEDS_GAIN_CLK_PIN,
+                  GPIO_MODE_OUTPUT_2MHZ, GPIO_CNF_OUTPUT_GP_PUSH_PULL);
+    for (i = 0; i < 5; i++) {
+        gpio_pin_set(LEDS_GAIN_GPIO, LEDS_GAIN_OE_PIN, i != 1);
+        gpio_pin_set(LEDS_LE_GPIO, LEDS_LE_PIN, special && i == 3);
+        gpio_pin_set(LEDS_GAIN_GPIO, LEDS_GAIN_CLK_PIN, true);
+        gpio_pin_set(LEDS_GAIN_GPIO, LEDS_GAIN_CLK_PIN, false);
+    }
+    gpio_pin_conf(LEDS_GAIN_GPIO, LEDS_GAIN_CLK_PIN,
+                  GPIO_MODE_OUTPUT_2MHZ, GPIO_CNF_OUTPUT_AF_PUSH_PULL);
+}
+
+/**
+ * Program the requested configuration code into all drivers. Must be
+ * called with the last step loaded, and the SPI idle. Leaves the shift
+ * registers holding the code, and LE low, so they don't reach the
+ * outputs until the next step is sent and loaded.
+ */
+static void
+leds_gain_program(void)
+{
+    uint8_t code = LEDS_GAIN_CODE_NEXT;
+    unsigned int discard;
+    size_t i;
+
+    LEDS_GAIN_PENDING = false;
+    leds_gain_mode(true);
+
+    /* Shift the code into each driver and latch it into configuration */
+    for (i = 0; i < LEDS_DRV_NUM; i++) {
+        while (!(LEDS_SPI->sr & SPI_SR_TXE_MASK));
+        LEDS_SPI->dr = code;
+    }
+    while (!(LEDS_SPI->sr & SPI_SR_TXE_MASK));
+    while (LEDS_SPI->sr & SPI_SR_BSY_MASK);
+    discard = LEDS_SPI->dr;
+    discard = LEDS_SPI->sr;
+    (void)discard;
+    gpio_pin_set(LEDS_LE_GPIO, LEDS_LE_PIN, true);
+    gpio_pin_set(LEDS_LE_GPIO, LEDS_LE_PIN, false);
+
+    leds_gain_mode(false);
+    /* Turn the outputs back on */
+    gpio_pin_set(LEDS_GAIN_GPIO, LEDS_GAIN_OE_PIN, false);
+}
+#endif
 
 void
 leds_step_load(void)
 {
     /* Enable loading the data to the outputs */
     gpio_pin_set(LEDS_LE_GPIO, LEDS_LE_PIN, true);
+#ifdef LEDS_GAIN
+    if (LEDS_GAIN_PENDING) {
+        leds_gain_program();
+    }
+#endif
 }
@@ -9,39 +9,110 @@
 #include <gpio.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
+
+/** Number of TLC5916 drivers in the chain, eight LEDs each */
+#ifndef LEDS_DRV_NUM
+#define LEDS_DRV_NUM    5
+#endif
 
 /** Number of LEDs */
-#define LEDS_NUM        40
+#define LEDS_NUM        (LEDS_DRV_NUM * 8)
+
+/**
+ * Number of LEDs laid out on the card, with the LED groups below indexing
+ * them. Any LEDs driven after them are extra.
+ */
+#define LEDS_CARD_NUM   40
+
+#if LEDS_NUM < LEDS_CARD_NUM
+#error "The driver chain is too short for the card LEDs"
+#endif
+
+/** LED index */
+#if LEDS_NUM < 256
+typedef uint8_t leds_idx;
+#else
+typedef uint16_t leds_idx;
+#endif
 
 /** Invalid LED index */
-#define LEDS_IDX_INVALID    255
+#define LEDS_IDX_INVALID    ((leds_idx)-1)
+
+/**
+ * Number of LED brightness bits: eight with temporal dithering, six
+ * without, matching the pulse length resolution.
+ */
+#ifdef LEDS_DITHER
+#define LEDS_BR_BITS    8
+#else
+#define LEDS_BR_BITS    6
+#endif
 
 /** Number of LED brightness values */
-#define LEDS_BR_NUM     64
+#define LEDS_BR_NUM     (1 << LEDS_BR_BITS)
 
 /** Maximum LED brightness value */
 #define LEDS_BR_MAX     (LEDS_BR_NUM - 1)
 
+/**
+ * Scale a brightness value, or difference, given in 64 levels to
+ * LEDS_BR_NUM levels.
+ *
+ * @param _br   The brightness in 64 levels.
+ */
+#define LEDS_BR_FROM_64(_br)    ((_br) * (LEDS_BR_NUM / 64))
+
 /** Brightness value of each LED */
 extern uint8_t LEDS_BR[LEDS_NUM];
 
+/** Number of PWM time units per cycle (the maximum pulse length) */
+#define LEDS_PL_MAX     64
+
+#ifdef LEDS_BCM
+/*
+ * Binary code modulation: each PWM step is a bit-plane of the LED pulse
+ * lengths, output for a time slot proportional to the bit weight. The
+ * last step is one unit long, and is on only for LEDs fully on, so that
+ * pulse length LEDS_PL_MAX lights the LED throughout the cycle.
+ */
+
+/** Number of PWM steps per cycle */
+#define LEDS_STEP_NUM   7
+
+/** Length of the specified PWM step, in PWM time units */
+#define LEDS_STEP_LEN(_step) \
+    ((_step) < LEDS_STEP_NUM - 1 ? 1u << (_step) : 1u)
+#else
+/*
+ * Linear PWM: each PWM step is one time unit long, with the LED on, if its
+ * pulse length is greater than the step number.
+ */
+
+/** Number of PWM steps per cycle */
+#define LEDS_STEP_NUM   LEDS_PL_MAX
+
+/** Length of the specified PWM step, in PWM time units */
+#define LEDS_STEP_LEN(_step) 1u
+#endif
+
 /** Number of star LEDs */
 #define LEDS_STARS_NUM  18
 
 /** List of indexes of star LEDs, left-to-right, top-to-bottom */
-extern const uint8_t LEDS_STARS_LIST[LEDS_STARS_NUM];
+extern const leds_idx LEDS_STARS_LIST[LEDS_STARS_NUM];
 
 /** Number of treetopper LEDs */
 #define LEDS_TOPPER_NUM 1
 
 /** List of indexes of treetopper LEDs, left-to-right, top-to-bottom */
-extern const uint8_t LEDS_TOPPER_LIST[LEDS_TOPPER_NUM];
+extern const leds_idx LEDS_TOPPER_LIST[LEDS_TOPPER_NUM];
 
 /** Number of ball LEDs */
 #define LEDS_BALLS_NUM  21
 
 /** List of indexes of ball LEDs, left-to-right, top-to-bottom */
-extern const uint8_t LEDS_BALLS_LIST[LEDS_BALLS_NUM];
+extern const leds_idx LEDS_BALLS_LIST[LEDS_BALLS_NUM];
 
 /**
  * Maximum length of a southwest-northeast diagonal line of ball LEDs,
@@ -56,8 +127,8 @@ extern const uint8_t LEDS_BALLS_LIST[LEDS_BALLS_NUM];
  * List of southwest-northeast diagonal lines of ball LEDs, top-to-bottom.
  * Each line contains LED indexes terminated by the invalid LED index.
  */
-extern const uint8_t LEDS_BALLS_SWNE_LINE_LIST[LEDS_BALLS_SWNE_LINE_NUM] \
-                                              [LEDS_BALLS_SWNE_LINE_LEN];
+extern const leds_idx LEDS_BALLS_SWNE_LINE_LIST[LEDS_BALLS_SWNE_LINE_NUM] \
+                                               [LEDS_BALLS_SWNE_LINE_LEN];
 
 /** Number of ball LED "rows" */
 #define LEDS_BALLS_ROW_NUM  11
@@ -72,8 +143,8 @@ extern const uint8_t LEDS_BALLS_SWNE_LINE_LIST[LEDS_BALLS_SWNE_LINE_NUM] \
  * corresponding "column" index. Otherwise it contains an index of ball LED
  * belonging to the "column".
  */
-extern const uint8_t LEDS_BALLS_ROW_LIST[LEDS_BALLS_ROW_NUM] \
-                                        [LEDS_BALLS_COL_NUM];
+extern const leds_idx LEDS_BALLS_ROW_LIST[LEDS_BALLS_ROW_NUM] \
+                                         [LEDS_BALLS_COL_NUM];
 
 /** Ball LED colors */
 enum leds_balls_color {
@@ -88,8 +159,8 @@ enum leds_balls_color {
 #define LEDS_BALLS_COLOR_LEN    7
 
 /** List of ball LED indexes by color, left to right, top to bottom */
-extern const uint8_t LEDS_BALLS_COLOR_LIST[LEDS_BALLS_COLOR_NUM]
-                                          [LEDS_BALLS_COLOR_LEN];
+extern const leds_idx LEDS_BALLS_COLOR_LIST[LEDS_BALLS_COLOR_NUM]
+                                           [LEDS_BALLS_COLOR_LEN];
 
 /**
  * Initialize LEDs module.
@@ -110,28 +181,147 @@ extern void leds_render(void);
 
 /**
  * Render current brightness of specified LEDs into the inactive PWM data
- * bank.
+ * bank. LEDs which pulse length the bank already holds are skipped.
  *
  * @param led_list  Array of indexes of LEDs to render.
  * @param led_num   Number of LEDs to render from the led_list array.
  */
-extern void leds_render_list(const uint8_t *led_list, size_t led_num);
+extern void leds_render_list(const leds_idx *led_list, size_t led_num);
+
+/**
+ * Finish rendering the inactive PWM data bank: find the PWM steps which
+ * differ from their previous steps. Must be called after rendering, before
+ * swapping the banks.
+ */
+extern void leds_render_finish(void);
 
 /**
  * Swap the active and inactive PWM data banks.
  */
 extern void leds_swap(void);
 
+#ifdef LEDS_DITHER
+/**
+ * Start a new PWM cycle, moving on to the next dithering phase of the
+ * active PWM data bank. Must be called before sending the first step of
+ * each cycle.
+ */
+extern void leds_cycle(void);
+#else
+static inline void leds_cycle(void) {}
+#endif
+
+/**
+ * Check if the specified LED state step of the active PWM data bank
+ * differs from the previous step, and so has to be sent and loaded.
+ * The first step is always considered changed.
+ *
+ * @param step  The step to check. Must be < LEDS_STEP_NUM.
+ *
+ * @return True if the step changed, false otherwise.
+ */
+extern bool leds_step_changed(size_t step);
+
+/**
+ * Find the next LED state step of the active PWM data bank which differs
+ * from its previous step.
+ *
+ * @param step  The step to start searching after. Must be < LEDS_STEP_NUM.
+ *
+ * @return The next changed step, or LEDS_STEP_NUM if none till the end of
+ *         the cycle.
+ */
+extern size_t leds_step_changed_next(size_t step);
+
+/**
+ * Check if all LED state steps of the active PWM data bank are the same,
+ * that is every LED is either fully on or fully off. Once the first step
+ * is loaded, the drivers hold the output without any more steps sent,
+ * until the banks are swapped.
+ *
+ * @return True if the active bank is static, false otherwise.
+ */
+extern bool leds_static(void);
+
 /**
  * Send the specified LED state step of the active PWM data bank.
+ * With LEDS_DMA defined, only start the transfer, and return immediately.
  *
- * @param step  The step to output. Must be <= LEDS_BR_MAX.
+ * @param step  The step to output. Must be < LEDS_STEP_NUM.
  */
 extern void leds_step_send(size_t step);
 
+#ifdef LEDS_DMA
+/**
+ * Finish sending an LED state step, once the DMA channel signals transfer
+ * completion. Must be called from the DMA1 channel 3 interrupt handler.
+ */
+extern void leds_step_done(void);
+#endif
+
+#ifndef LEDS_DMA
+/**
+ * Wait for the last sent LED state step to be shifted out completely.
+ */
+extern void leds_step_flush(void);
+#endif
+
 /**
  * Load the last sent LED state.
+ * With LEDS_GAIN defined, also program the drivers' current gain, if
+ * requested with leds_gain_set().
  */
 extern void leds_step_load(void);
 
+#ifdef LEDS_GAIN
+/*
+ * Driver current gain: in special mode TLC5916 shifts an 8-bit
+ * configuration code into each driver, scaling the output current of all
+ * its outputs. Entering and leaving special mode takes pulsing OE low for
+ * one of five clocks, with the CLK pin switched to GPIO, so OE has to be
+ * wired to a GPIO pin, instead of ground as on the card.
+ *
+ * The gain is (1 + HC) * (1 + D / 64) / 4, divided by three if CM is
+ * zero, ranging from 1/12 to 127/128, where the default code 0xff is.
+ */
+
+/**
+ * Make a driver configuration code.
+ *
+ * @param _cm   Current multiplier bit: 1 for the high current range.
+ * @param _hc   High current bit: 1 to double the gain.
+ * @param _d    Current gain adjustment, 0-63.
+ */
+#define LEDS_GAIN_CODE(_cm, _hc, _d) \
+    ((uint8_t)(((_cm) & 1) | ((_hc) & 1) << 1 |                 \
+               ((_d) >> 5 & 1) << 2 | ((_d) >> 4 & 1) << 3 |    \
+               ((_d) >> 3 & 1) << 4 | ((_d) >> 2 & 1) << 5 |    \
+               ((_d) >> 1 & 1) << 6 | ((_d) & 1) << 7))
+
+/** Default driver configuration code, at power-up */
+#define LEDS_GAIN_CODE_DEFAULT  LEDS_GAIN_CODE(1, 1, 63)
+
+/**
+ * Initialize driver current gain control. Must be called after
+ * leds_init(), with CLK configured as an alternate function push-pull
+ * output, and OE as a general-purpose push-pull output, set low.
+ *
+ * @param gpio      The GPIO peripheral with the CLK and OE pins.
+ * @param clk_pin   The GPIO pin outputting the SPI clock to CLK.
+ * @param oe_pin    The GPIO pin controlling the output-enable (OE) signal.
+ */
+extern void leds_gain_init(volatile struct gpio *gpio,
+                           unsigned int clk_pin,
+                           unsigned int oe_pin);
+
+/**
+ * Request programming a configuration code into all drivers in the chain.
+ * The code is programmed by the next leds_step_load(), in the interrupt
+ * handler, with the outputs off for the few microseconds it takes.
+ *
+ * @param code  The configuration code, see LEDS_GAIN_CODE().
+ */
+extern void leds_gain_set(uint8_t code);
+#endif
+
 #endif /* _LEDS_H */
@@ -0,0 +1,250 @@
+/*
+ * Linker map memory budget checker
+ *
+ * Reads a GNU ld map file, outputs the .text (including read-only data),
+ * .data and .bss bytes each module contributes to the image, and checks
+ * the totals against the flash and RAM budgets.
+ *
+ * Usage: map-budget MAP FLASH_BUDGET RAM_BUDGET STACK_SIZE
+ *
+ * MAP is the map file, FLASH_BUDGET and RAM_BUDGET are the flash and RAM
+ * bytes the image can use, and STACK_SIZE is the bytes of RAM reserved for
+ * the main stack, outside any module. Flash holds .text and the initial
+ * .data, and RAM holds .data, .bss and the main stack.
+ *
+ * Exits with status 1 if a budget is exceeded, 2 on other errors.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+/** Maximum number of modules */
+#define MAP_BUDGET_MOD_MAX  128
+
+/** Maximum length of a map line and of a module name */
+#define MAP_BUDGET_LINE_MAX 512
+
+/** Section kinds */
+enum map_budget_kind {
+    MAP_BUDGET_KIND_TEXT,
+    MAP_BUDGET_KIND_DATA,
+    MAP_BUDGET_KIND_BSS,
+    MAP_BUDGET_KIND_NUM
+};
+
+/** A module's contribution to the image */
+struct map_budget_mod {
+    /** Module (object file) name */
+    char        name[MAP_BUDGET_LINE_MAX];
+    /** Bytes, by section kind */
+    uint32_t    size[MAP_BUDGET_KIND_NUM];
+};
+
+/** Modules seen so far */
+static struct map_budget_mod MAP_BUDGET_MOD_LIST[MAP_BUDGET_MOD_MAX];
+
+/** Number of modules in MAP_BUDGET_MOD_LIST */
+static size_t MAP_BUDGET_MOD_NUM;
+
+/** Start of RAM in the address space */
+#define MAP_BUDGET_RAM_ADDR 0x20000000
+
+/**
+ * Get the kind of memory an input section takes up.
+ *
+ * @param output    Name of the output section the input section is in.
+ * @param input     Name of the input section.
+ * @param addr      Address of the input section.
+ *
+ * @return The section kind.
+ */
+static enum map_budget_kind
+map_budget_kind(const char *output, const char *input,
+                unsigned long long addr)
+{
+    if (strncmp(output, ".bss", 4) == 0 ||
+        strncmp(input, ".bss", 4) == 0 || strcmp(input, "COMMON") == 0) {
+        return MAP_BUDGET_KIND_BSS;
+    } else if (strncmp(output, ".data", 5) == 0 ||
+               strncmp(input, ".data", 5) == 0) {
+        return MAP_BUDGET_KIND_DATA;
+    } else if (addr >= MAP_BUDGET_RAM_ADDR) {
+        /* Not loaded into RAM from flash */
+        return MAP_BUDGET_KIND_BSS;
+    } else {
+        return MAP_BUDGET_KIND_TEXT;
+    }
+}
+
+/**
+ * Add bytes to a module.
+ *
+ * @param path  The module object file path, as in the map.
+ * @param kind  The kind of the section the bytes are in.
+ * @param size  Number of bytes.
+ *
+ * @return True if added, false if there are too many modules.
+ */
+static bool
+map_budget_add(const char *path, enum map_budget_kind kind, uint32_t size)
+{
+    const char *name;
+    const char *p;
+    size_t i;
+
+    /* Strip the directory, keeping any library member */
+    name = path;
+    for (p = path; *p != '\0' && *p != '('; p++) {
+        if (*p == '/') {
+            name = p + 1;
+        }
+    }
+
+    for (i = 0; i < MAP_BUDGET_MOD_NUM; i++) {
+        if (strcmp(MAP_BUDGET_MOD_LIST[i].name, name) == 0) {
+            break;
+        }
+    }
+    if (i == MAP_BUDGET_MOD_NUM) {
+        if (MAP_BUDGET_MOD_NUM >= MAP_BUDGET_MOD_MAX) {
+            return false;
+        }
+        snprintf(MAP_BUDGET_MOD_LIST[i].name,
+                 sizeof(MAP_BUDGET_MOD_LIST[i].name), "%s", name);
+        MAP_BUDGET_MOD_NUM++;
+    }
+    MAP_BUDGET_MOD_LIST[i].size[kind] += size;
+    return true;
+}
+
+/**
+ * Check a total against a budget, and output the result.
+ *
+ * @param name      The budget name.
+ * @param total     The total bytes used.
+ * @param budget    The budget bytes.
+ *
+ * @return True if the total is within the budget, false otherwise.
+ */
+static bool
+map_budget_check(const char *name, uint32_t total, uint32_t budget)
+{
+    bool ok = total <= budget;
+    printf("%-5s %8" PRIu32 " of %8" PRIu32 " bytes, %3" PRIu32 "%%%s\n",
+           name, total, budget,
+           budget == 0 ? 0 : (uint32_t)((uint64_t)total * 100 / budget),
+           ok ? "" : ", OVER BUDGET");
+    return ok;
+}
+
+int
+main(int argc, char **argv)
+{
+    FILE *map;
+    char line[MAP_BUDGET_LINE_MAX];
+    char output[MAP_BUDGET_LINE_MAX] = "";
+    char input[MAP_BUDGET_LINE_MAX] = "";
+    char path[MAP_BUDGET_LINE_MAX];
+    unsigned long long addr;
+    unsigned long long size;
+    uint32_t flash_budget;
+    uint32_t ram_budget;
+    uint32_t stack_size;
+    uint32_t total[MAP_BUDGET_KIND_NUM] = {0};
+    enum map_budget_kind kind;
+    bool started = false;
+    bool ok;
+    size_t i;
+
+    if (argc != 5) {
+        fprintf(stderr,
+                "Usage: %s MAP FLASH_BUDGET RAM_BUDGET STACK_SIZE\n",
+                argv[0]);
+        return 2;
+    }
+    flash_budget = strtoul(argv[2], NULL, 0);
+    ram_budget = strtoul(argv[3], NULL, 0);
+    stack_size = strtoul(argv[4], NULL, 0);
+
+    map = fopen(argv[1], "r");
+    if (map == NULL) {
+        perror(argv[1]);
+        return 2;
+    }
+
+    while (fgets(line, sizeof(line), map) != NULL) {
+        /* Skip the discarded sections and the memory configuration */
+        if (!started) {
+            started = strncmp(line, "Linker script and memory map",
+                              28) == 0;
+            continue;
+        }
+        /* Output sections start at the beginning of the line */
+        if (line[0] != ' ' && line[0] != '\n') {
+            sscanf(line, "%511s", output);
+            input[0] = '\0';
+            continue;
+        }
+        /* Input sections are indented by one space */
+        if (line[1] != ' ') {
+            if (sscanf(line, " %511s 0x%llx 0x%llx %511s",
+                       input, &addr, &size, path) != 4) {
+                /* A long name has the rest on the next line */
+                if (sscanf(line, " %511s %511s", input, path) != 1) {
+                    input[0] = '\0';
+                }
+                continue;
+            }
+        } else if (input[0] == '\0' ||
+                   sscanf(line, " 0x%llx 0x%llx %511s",
+                          &addr, &size, path) != 3) {
+            input[0] = '\0';
+            continue;
+        }
+
+        /* Skip fills, and sections not in the image */
+        if (input[0] == '*' || addr == 0 || size == 0) {
+            input[0] = '\0';
+            continue;
+        }
+        kind = map_budget_kind(output, input, addr);
+        input[0] = '\0';
+        if (!map_budget_add(path, kind, size)) {
+            fprintf(stderr, "Too many modules\n");
+            return 2;
+        }
+        total[kind] += size;
+    }
+    if (ferror(map)) {
+        perror(argv[1]);
+        return 2;
+    }
+    fclose(map);
+
+    printf("%-32s %8s %8s %8s\n", "module", "text", "data", "bss");
+    for (i = 0; i < MAP_BUDGET_MOD_NUM; i++) {
+        printf("%-32s %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\n",
+               MAP_BUDGET_MOD_LIST[i].name,
+               MAP_BUDGET_MOD_LIST[i].size[MAP_BUDGET_KIND_TEXT],
+               MAP_BUDGET_MOD_LIST[i].size[MAP_BUDGET_KIND_DATA],
+               MAP_BUDGET_MOD_LIST[i].size[MAP_BUDGET_KIND_BSS]);
+    }
+    printf("%-32s %8" PRIu32 " %8" PRIu32 " %8" PRIu32 "\n", "total",
+           total[MAP_BUDGET_KIND_TEXT], total[MAP_BUDGET_KIND_DATA],
+           total[MAP_BUDGET_KIND_BSS]);
+    printf("%-32s %8s %8s %8" PRIu32 "\n", "main stack", "", "", stack_size);
+    printf("\n");
+
+    ok = map_budget_check("flash",
+                          total[MAP_BUDGET_KIND_TEXT] +
+                          total[MAP_BUDGET_KIND_DATA],
+                          flash_budget);
+    ok = map_budget_check("RAM",
+                          total[MAP_BUDGET_KIND_DATA] +
+                          total[MAP_BUDGET_KIND_BSS] + stack_size,
+                          ram_budget) && ok;
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+/*
+ * Performance profiling
+ */
+
+#include "prof.h"
+#include <dbg.h>
+#include <stddef.h>
+#ifdef HOST
+#include <stdio.h>
+#include <stdlib.h>
+#endif
+
+#ifdef PROF
+volatile struct prof_stat PROF_TICK[2];
+uint32_t PROF_TICK_START;
+volatile struct prof_swap PROF_SWAP;
+uint32_t PROF_RENDER_START;
+#endif
+
+void
+prof_stat_add(volatile struct prof_stat *stat, uint32_t cycles)
+{
+    if (stat->num == 0 || cycles < stat->min) {
+        stat->min = cycles;
+    }
+    if (cycles > stat->max) {
+        stat->max = cycles;
+    }
+    stat->sum += cycles;
+    stat->num++;
+}
+
+uint32_t
+prof_stat_mean(const volatile struct prof_stat *stat)
+{
+    return stat->num == 0 ? 0 : stat->sum / stat->num;
+}
+
+void
+prof_tick_get(bool odd, struct prof_stat *stat)
+{
+#ifdef PROF
+    /* Re-read until the handler didn't update the stats under us */
+    do {
+        stat->num = PROF_TICK[odd].num;
+        stat->min = PROF_TICK[odd].min;
+        stat->max = PROF_TICK[odd].max;
+        stat->sum = PROF_TICK[odd].sum;
+    } while (stat->num != PROF_TICK[odd].num);
+#else
+    (void)odd;
+    stat->num = stat->min = stat->max = 0;
+    stat->sum = 0;
+#endif
+}
+
+void
+prof_tick_reset(void)
+{
+#ifdef PROF
+    size_t i;
+    for (i = 0; i < 2; i++) {
+        PROF_TICK[i].num = 0;
+        PROF_TICK[i].min = 0;
+        PROF_TICK[i].max = 0;
+        PROF_TICK[i].sum = 0;
+    }
+#endif
+}
+
+void
+prof_swap_get(struct prof_swap *swap)
+{
+#ifdef PROF
+    size_t i;
+
+    /* Re-read until the handler didn't swap under us */
+    do {
+        swap->lag.num = PROF_SWAP.lag.num;
+        swap->lag.min = PROF_SWAP.lag.min;
+        swap->lag.max = PROF_SWAP.lag.max;
+        swap->lag.sum = PROF_SWAP.lag.sum;
+        for (i = 0; i < PROF_SWAP_HIST_NUM; i++) {
+            swap->hist[i] = PROF_SWAP.hist[i];
+        }
+    } while (swap->lag.num != PROF_SWAP.lag.num);
+    swap->late = PROF_SWAP.late;
+    swap->render.num = PROF_SWAP.render.num;
+    swap->render.min = PROF_SWAP.render.min;
+    swap->render.max = PROF_SWAP.render.max;
+    swap->render.sum = PROF_SWAP.render.sum;
+#else
+    size_t i;
+
+    swap->lag.num = swap->lag.min = swap->lag.max = 0;
+    swap->lag.sum = 0;
+    for (i = 0; i < PROF_SWAP_HIST_NUM; i++) {
+        swap->hist[i] = 0;
+    }
+    swap->late = 0;
+    swap->render.num = swap->render.min = swap->render.max = 0;
+    swap->render.sum = 0;
+#endif
+}
+
+void
+prof_swap_reset(void)
+{
+#ifdef PROF
+    size_t i;
+
+    /* Re-reset until the handler didn't swap under us */
+    do {
+        PROF_SWAP.lag.num = 0;
+        PROF_SWAP.lag.min = 0;
+        PROF_SWAP.lag.max = 0;
+        PROF_SWAP.lag.sum = 0;
+        for (i = 0; i < PROF_SWAP_HIST_NUM; i++) {
+            PROF_SWAP.hist[i] = 0;
+        }
+    } while (PROF_SWAP.lag.num != 0);
+    PROF_SWAP.late = 0;
+    PROF_SWAP.render.num = 0;
+    PROF_SWAP.render.min = 0;
+    PROF_SWAP.render.max = 0;
+    PROF_SWAP.render.sum = 0;
+#endif
+}
+
+#if defined(PROF) && defined(HOST)
+/**
+ * Output profiling statistics on simulation exit.
+ */
+static void
+prof_report(void)
+{
+    static const char *name[2] = {"even", "odd"};
+    struct prof_stat stat;
+    struct prof_swap swap;
+    size_t i;
+
+    for (i = 0; i < 2; i++) {
+        prof_tick_get(i, &stat);
+        fprintf(stderr, "prof: %s ticks: %u, cycles min/mean/max: "
+                        "%u/%u/%u\n",
+                name[i], stat.num, stat.min, prof_stat_mean(&stat),
+                stat.max);
+    }
+
+    prof_swap_get(&swap);
+    fprintf(stderr, "prof: swaps: %u, lag ticks min/mean/max: %u/%u/%u\n",
+            swap.lag.num, swap.lag.min, prof_stat_mean(&swap.lag),
+            swap.lag.max);
+    fprintf(stderr, "prof: swap lag histogram, ticks:");
+    for (i = 0; i < PROF_SWAP_HIST_NUM; i++) {
+        if (i < 2) {
+            fprintf(stderr, " %zu:%u", i, swap.hist[i]);
+        } else if (i < PROF_SWAP_HIST_NUM - 1) {
+            fprintf(stderr, " %u-%u:%u", 1u << (i - 1), (1u << i) - 1,
+                    swap.hist[i]);
+        } else {
+            fprintf(stderr, " %u+:%u", 1u << (i - 1), swap.hist[i]);
+        }
+    }
+    fprintf(stderr, "\n");
+    fprintf(stderr, "prof: anim steps: %u, late: %u, "
+                    "render cycles min/mean/max: %u/%u/%u\n",
+            swap.render.num, swap.late, swap.render.min,
+            prof_stat_mean(&swap.render), swap.render.max);
+}
+#endif
+
+void
+prof_cycles_init(void)
+{
+    /* Enable trace, and the cycle counter */
+    DBG->demcr |= DBG_DEMCR_TRCENA_MASK;
+    DWT->cyccnt = 0;
+    DWT->ctrl |= DWT_CTRL_CYCCNTENA_MASK;
+}
+
+#ifdef PROF
+void
+prof_init(void)
+{
+    prof_cycles_init();
+#ifdef HOST
+    atexit(prof_report);
+#endif
+}
+#endif
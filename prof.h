@@ -0,0 +1,214 @@
+/*
+ * Performance profiling
+ */
+
+#ifndef _PROF_H
+#define _PROF_H
+
+#include <dwt.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Cycle count statistics */
+struct prof_stat {
+    /** Number of samples */
+    uint32_t    num;
+    /** Minimum cycle count */
+    uint32_t    min;
+    /** Maximum cycle count */
+    uint32_t    max;
+    /** Sum of all cycle counts */
+    uint64_t    sum;
+};
+
+/**
+ * Enable the cycle counter, for prof_cycles(). Done by prof_init() for
+ * profiling, and can be done without it, e.g. for benchmarking.
+ */
+extern void prof_cycles_init(void);
+
+#ifdef PROF
+/**
+ * Initialize profiling: enable the cycle counter.
+ */
+extern void prof_init(void);
+#else
+static inline void prof_init(void) {}
+#endif
+
+/**
+ * Read the cycle counter.
+ *
+ * @return Current cycle count, rolls over every ~60s at 72MHz.
+ */
+static inline uint32_t
+prof_cycles(void)
+{
+    return DWT->cyccnt;
+}
+
+/**
+ * Add a sample to cycle count statistics.
+ *
+ * @param stat      The statistics to add the sample to.
+ * @param cycles    The sample cycle count.
+ */
+extern void prof_stat_add(volatile struct prof_stat *stat, uint32_t cycles);
+
+/**
+ * Get mean cycle count of statistics.
+ *
+ * @param stat  The statistics to get the mean of.
+ *
+ * @return The mean cycle count, or zero if there are no samples.
+ */
+extern uint32_t prof_stat_mean(const volatile struct prof_stat *stat);
+
+#ifdef PROF
+
+/**
+ * SysTick handler cycle count statistics, by tick parity: even (send and
+ * swap) ticks at index 0, and odd (load) ticks at index 1.
+ * Can be read with a debugger, or with prof_tick_get().
+ */
+extern volatile struct prof_stat PROF_TICK[2];
+
+/** Cycle count at the start of the current tick */
+extern uint32_t PROF_TICK_START;
+
+/**
+ * Mark the start of a SysTick handler tick.
+ */
+static inline void
+prof_tick_start(void)
+{
+    PROF_TICK_START = prof_cycles();
+}
+
+/**
+ * Mark the end of a SysTick handler tick and account its cycles.
+ *
+ * @param odd   True if the tick was odd, false if even.
+ */
+static inline void
+prof_tick_end(bool odd)
+{
+    prof_stat_add(&PROF_TICK[odd], prof_cycles() - PROF_TICK_START);
+}
+
+#endif /* PROF */
+
+/**
+ * Number of swap lag histogram buckets: zero ticks, then each power of two
+ * up to the last bucket, holding all longer lags.
+ */
+#define PROF_SWAP_HIST_NUM  16
+
+/** LED bank swap timing statistics */
+struct prof_swap {
+    /** Lag of swaps behind their scheduled tick, ticks */
+    struct prof_stat    lag;
+    /**
+     * Number of swaps by lag: zero ticks in bucket zero, from 2^(n-1) to
+     * 2^n - 1 ticks in bucket n, and the rest in the last one.
+     */
+    uint32_t            hist[PROF_SWAP_HIST_NUM];
+    /**
+     * Number of animation steps rendered too late for their swap to happen
+     * at the PWM cycle it's scheduled for
+     */
+    uint32_t            late;
+    /**
+     * Animation step render cycle counts, including any interrupt
+     * handlers running meanwhile
+     */
+    struct prof_stat    render;
+};
+
+#ifdef PROF
+
+/**
+ * LED bank swap timing statistics.
+ * Can be read with a debugger, or with prof_swap_get().
+ */
+extern volatile struct prof_swap PROF_SWAP;
+
+/** Cycle count at the start of the current animation step render */
+extern uint32_t PROF_RENDER_START;
+
+/**
+ * Account an LED bank swap.
+ *
+ * @param lag   Number of ticks the swap happened after its scheduled tick.
+ */
+static inline void
+prof_swap(uint32_t lag)
+{
+    size_t bucket = lag == 0 ? 0 : 32 - __builtin_clz(lag);
+    prof_stat_add(&PROF_SWAP.lag, lag);
+    PROF_SWAP.hist[bucket < PROF_SWAP_HIST_NUM ? bucket
+                                               : PROF_SWAP_HIST_NUM - 1]++;
+}
+
+/**
+ * Mark the start of an animation step render.
+ */
+static inline void
+prof_render_start(void)
+{
+    PROF_RENDER_START = prof_cycles();
+}
+
+/**
+ * Mark the end of an animation step render and account its cycles.
+ *
+ * @param late  True if the swap of the rendered step is already late.
+ */
+static inline void
+prof_render_end(bool late)
+{
+    prof_stat_add(&PROF_SWAP.render, prof_cycles() - PROF_RENDER_START);
+    PROF_SWAP.late += late;
+}
+
+#else
+
+static inline void prof_tick_start(void) {}
+static inline void prof_tick_end(bool odd) { (void)odd; }
+static inline void prof_swap(uint32_t lag) { (void)lag; }
+static inline void prof_render_start(void) {}
+static inline void prof_render_end(bool late) { (void)late; }
+
+#endif /* PROF */
+
+/**
+ * Get a consistent copy of SysTick handler tick statistics.
+ * The statistics are all zero, if profiling is compiled out.
+ *
+ * @param odd   True to get odd tick statistics, false for even ticks.
+ * @param stat  Location for the statistics.
+ */
+extern void prof_tick_get(bool odd, struct prof_stat *stat);
+
+/**
+ * Reset SysTick handler tick statistics.
+ */
+extern void prof_tick_reset(void);
+
+/**
+ * Get a consistent copy of LED bank swap timing statistics. Must be
+ * called from the main loop. The statistics are all zero, if profiling is
+ * compiled out.
+ *
+ * @param swap  Location for the statistics.
+ */
+extern void prof_swap_get(struct prof_swap *swap);
+
+/**
+ * Reset LED bank swap timing statistics. Must be called from the main
+ * loop.
+ */
+extern void prof_swap_reset(void);
+
+#endif /* _PROF_H */
@@ -0,0 +1,64 @@
+/*
+ * Counter-based random number streams
+ */
+
+#include "rng.h"
+
+/** Philox2x32 round multiplier */
+#define RNG_PHILOX_M        0xd256d193u
+
+/** Philox2x32 key increment (Weyl sequence) */
+#define RNG_PHILOX_W        0x9e3779b9u
+
+/** Number of Philox2x32 rounds */
+#define RNG_PHILOX_ROUNDS   10
+
+/**
+ * Compute the two values of a Philox2x32 counter block.
+ *
+ * @param key   The key.
+ * @param ctr0  The first counter word, the block index.
+ * @param ctr1  The second counter word, the stream number.
+ * @param out   Location for the two values.
+ */
+static void
+rng_block(uint32_t key, uint32_t ctr0, uint32_t ctr1, uint32_t out[2])
+{
+    uint64_t prod;
+    unsigned int i;
+
+    for (i = 0; i < RNG_PHILOX_ROUNDS; i++) {
+        prod = (uint64_t)RNG_PHILOX_M * ctr0;
+        ctr0 = (uint32_t)(prod >> 32) ^ key ^ ctr1;
+        ctr1 = (uint32_t)prod;
+        key += RNG_PHILOX_W;
+    }
+    out[0] = ctr0;
+    out[1] = ctr1;
+}
+
+void
+rng_init(struct rng *rng, uint32_t seed, uint32_t stream)
+{
+    rng->key = seed;
+    rng->stream = stream;
+    rng->pos = 0;
+}
+
+void
+rng_fill(struct rng *rng, uint32_t *list, size_t num, uint32_t bound)
+{
+    uint32_t block[2];
+    uint32_t pos = rng->pos;
+    size_t i;
+
+    for (i = 0; i < num; pos++, i++) {
+        /* Compute the block at its first value, or at the start */
+        if (i == 0 || (pos & 1) == 0) {
+            rng_block(rng->key, pos >> 1, rng->stream, block);
+        }
+        list[i] = bound == 0 ? block[pos & 1]
+                             : rng_scale(block[pos & 1], bound);
+    }
+    rng->pos = pos;
+}
@@ -0,0 +1,90 @@
+/*
+ * Counter-based random number streams
+ *
+ * Each value is the Philox2x32-10 function of a key, the stream number,
+ * and the value's position in the stream, so streams don't affect each
+ * other, and can be positioned anywhere at no cost. Every two consecutive
+ * values, starting from an even position, come from one function call.
+ */
+
+#ifndef _RNG_H
+#define _RNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Random number stream */
+struct rng {
+    /** Key, common to all streams of a seed */
+    uint32_t    key;
+    /** Stream number */
+    uint32_t    stream;
+    /** Position of the next value in the stream */
+    uint32_t    pos;
+};
+
+/**
+ * Initialize a random number stream, positioned at the start.
+ *
+ * @param rng       The stream to initialize.
+ * @param seed      The seed (key) of the stream.
+ * @param stream    The stream number.
+ */
+extern void rng_init(struct rng *rng, uint32_t seed, uint32_t stream);
+
+/**
+ * Position a random number stream.
+ *
+ * @param rng   The stream to position.
+ * @param pos   Position of the value to get next.
+ */
+static inline void
+rng_seek(struct rng *rng, uint32_t pos)
+{
+    rng->pos = pos;
+}
+
+/**
+ * Scale a random value to a range.
+ *
+ * @param value The random value.
+ * @param bound The exclusive upper bound of the range, starting at zero.
+ *
+ * @return The scaled value.
+ */
+static inline uint32_t
+rng_scale(uint32_t value, uint32_t bound)
+{
+    return ((uint64_t)value * bound) >> 32;
+}
+
+/**
+ * Fill a buffer with the next values from a random number stream.
+ *
+ * @param rng   The stream to get the values from.
+ * @param list  The buffer to fill [num].
+ * @param num   Number of values to get.
+ * @param bound The exclusive upper bound of the values, starting at zero,
+ *              or zero for the full 32-bit values.
+ */
+extern void rng_fill(struct rng *rng, uint32_t *list, size_t num,
+                     uint32_t bound);
+
+/**
+ * Get the next value from a random number stream.
+ *
+ * @param rng   The stream to get the value from.
+ * @param bound The exclusive upper bound of the value, starting at zero,
+ *              or zero for the full 32-bit value.
+ *
+ * @return The value.
+ */
+static inline uint32_t
+rng_next(struct rng *rng, uint32_t bound)
+{
+    uint32_t value;
+    rng_fill(rng, &value, 1, bound);
+    return value;
+}
+
+#endif /* _RNG_H */
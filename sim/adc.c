@@ -0,0 +1,91 @@
+/*
+ * Analog-to-digital converter (ADC) - host stand-in for libstammer
+ *
+ * Calibration and conversions complete instantly. Conversions return
+ * successive bytes of the simulation seed, most significant first, so the
+ * firmware collecting the low bytes of four readings gets exactly the seed.
+ */
+
+#include "sim.h"
+#include <adc.h>
+
+volatile struct adc SIM_ADC1 SIM_MMIO;
+
+/** Control register 2 value before the last write */
+static uint32_t SIM_ADC1_CR2;
+
+/** Number of conversions done */
+static unsigned int SIM_ADC1_CONV;
+
+/**
+ * Reset the ADC.
+ *
+ * @param periph    The ADC description.
+ */
+static void
+sim_adc_init(const struct sim_periph *periph)
+{
+    (void)periph;
+    SIM_ADC1_CR2 = 0;
+    SIM_ADC1_CONV = 0;
+}
+
+/**
+ * Prepare an ADC register for reading.
+ *
+ * @param periph    The ADC description.
+ * @param off       Offset of the register being read.
+ */
+static void
+sim_adc_read(const struct sim_periph *periph, size_t off)
+{
+    volatile struct adc *adc = periph->regs;
+    /* Reading the data register clears end of conversion */
+    if (off == offsetof(struct adc, dr)) {
+        adc->sr &= ~ADC_SR_EOC_MASK;
+    }
+}
+
+/**
+ * Handle an ADC register write.
+ *
+ * @param periph    The ADC description.
+ * @param off       Offset of the written register.
+ */
+static void
+sim_adc_write(const struct sim_periph *periph, size_t off)
+{
+    volatile struct adc *adc = periph->regs;
+    uint32_t cr2;
+
+    if (off != offsetof(struct adc, cr2)) {
+        return;
+    }
+
+    cr2 = adc->cr2;
+
+    /*
+     * Setting ADON when it's already set starts a conversion, unless any
+     * other bit is changed at the same time.
+     */
+    if ((SIM_ADC1_CR2 & cr2 & ADC_CR2_ADON_MASK) &&
+        ((SIM_ADC1_CR2 ^ cr2) & ~ADC_CR2_ADON_MASK) == 0) {
+        adc->dr = (SIM_SEED >> (24 - (SIM_ADC1_CONV & 3) * 8)) & 0xff;
+        adc->sr |= ADC_SR_EOC_MASK;
+        SIM_ADC1_CONV++;
+    }
+
+    /* Calibrate instantly */
+    adc->cr2 = cr2 & ~(ADC_CR2_CAL_MASK | ADC_CR2_RSTCAL_MASK);
+
+    SIM_ADC1_CR2 = adc->cr2;
+}
+
+const struct sim_periph SIM_ADC1_PERIPH = {
+    .name = "adc1",
+    .regs = &SIM_ADC1,
+    .size = sizeof(SIM_ADC1),
+    .init = sim_adc_init,
+    .read = sim_adc_read,
+    .write = sim_adc_write,
+};
@@ -0,0 +1,71 @@
+/*
+ * Analog-to-digital converter (ADC) - host stand-in for libstammer
+ */
+
+#ifndef _ADC_H
+#define _ADC_H
+
+#include <stdint.h>
+
+/** ADC registers */
+struct adc {
+    uint32_t sr;
+    uint32_t cr1;
+    uint32_t cr2;
+    uint32_t smpr1;
+    uint32_t smpr2;
+    uint32_t jofr1;
+    uint32_t jofr2;
+    uint32_t jofr3;
+    uint32_t jofr4;
+    uint32_t htr;
+    uint32_t ltr;
+    uint32_t sqr1;
+    uint32_t sqr2;
+    uint32_t sqr3;
+    uint32_t jsqr;
+    uint32_t jdr1;
+    uint32_t jdr2;
+    uint32_t jdr3;
+    uint32_t jdr4;
+    uint32_t dr;
+};
+
+/* Status register */
+#define ADC_SR_EOC_MASK         (1 << 1)
+
+/* Control register 2 */
+#define ADC_CR2_ADON_MASK       (1 << 0)
+#define ADC_CR2_CONT_MASK       (1 << 1)
+#define ADC_CR2_CAL_MASK        (1 << 2)
+#define ADC_CR2_RSTCAL_MASK     (1 << 3)
+#define ADC_CR2_TSVREFE_MASK    (1 << 23)
+
+/* Sample time registers */
+enum adc_smprx_smpx_val {
+    ADC_SMPRX_SMPX_VAL_1_5C,
+    ADC_SMPRX_SMPX_VAL_7_5C,
+    ADC_SMPRX_SMPX_VAL_13_5C,
+    ADC_SMPRX_SMPX_VAL_28_5C,
+    ADC_SMPRX_SMPX_VAL_41_5C,
+    ADC_SMPRX_SMPX_VAL_55_5C,
+    ADC_SMPRX_SMPX_VAL_71_5C,
+    ADC_SMPRX_SMPX_VAL_239_5C
+};
+#define ADC_SMPR1_SMP16_LSB     18
+#define ADC_SMPR1_SMP16_MASK    (7 << ADC_SMPR1_SMP16_LSB)
+
+/* Regular sequence register 3 */
+#define ADC_SQR3_SQ1_LSB        0
+#define ADC_SQR3_SQ1_MASK       (0x1f << ADC_SQR3_SQ1_LSB)
+
+/** Simulated ADC1 registers */
+extern volatile struct adc SIM_ADC1;
+
+/** ADC1 */
+#define ADC1 (&SIM_ADC1)
+
+/** Simulated ADC1 description */
+extern const struct sim_periph SIM_ADC1_PERIPH;
+
+#endif /* _ADC_H */
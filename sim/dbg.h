@@ -0,0 +1,30 @@
+/*
+ * Core debug registers - host stand-in for libstammer
+ */
+
+#ifndef _DBG_H
+#define _DBG_H
+
+#include <stdint.h>
+
+/** Core debug registers */
+struct dbg {
+    uint32_t dhcsr;
+    uint32_t dcrsr;
+    uint32_t dcrdr;
+    uint32_t demcr;
+};
+
+/* Debug exception and monitor control register */
+#define DBG_DEMCR_TRCENA_MASK   (1 << 24)
+
+/** Simulated core debug registers */
+extern volatile struct dbg SIM_DBG;
+
+/** Core debug */
+#define DBG (&SIM_DBG)
+
+/** Simulated core debug description */
+extern const struct sim_periph SIM_DBG_PERIPH;
+
+#endif /* _DBG_H */
@@ -0,0 +1,183 @@
+/*
+ * Direct memory access controller (DMA) - host stand-in for libstammer
+ *
+ * Only memory-to-SPI1 byte transfers are supported, taking the time SPI
+ * needs to shift the bytes out at its configured baud rate. The data is
+ * shifted into the simulated chain when the transfer completes.
+ */
+
+#include "sim.h"
+#include <dma.h>
+#include <spi.h>
+#include <nvic.h>
+#include <misc.h>
+#include <inttypes.h>
+
+volatile struct dma SIM_DMA1 SIM_MMIO;
+
+/** Number of channels */
+#define SIM_DMA1_CH_NUM ARRAY_SIZE(SIM_DMA1.ch)
+
+/** Transfer completion time of each channel, UINT64_MAX if idle */
+static uint64_t SIM_DMA1_DONE[SIM_DMA1_CH_NUM];
+
+/** Number of transfers completed */
+static uint64_t SIM_DMA1_TRANSFERS;
+
+/** Number of interrupts fired */
+static uint64_t SIM_DMA1_IRQS;
+
+/** Channel interrupt handlers */
+static void (*const SIM_DMA1_HANDLER[SIM_DMA1_CH_NUM])(void) = {
+    dma1_channel1_handler,
+    dma1_channel2_handler,
+    dma1_channel3_handler,
+    dma1_channel4_handler,
+    dma1_channel5_handler,
+    dma1_channel6_handler,
+    dma1_channel7_handler,
+};
+
+/**
+ * Reset the DMA controller.
+ *
+ * @param periph    The DMA controller description.
+ */
+static void
+sim_dma_init(const struct sim_periph *periph)
+{
+    size_t i;
+    (void)periph;
+    for (i = 0; i < SIM_DMA1_CH_NUM; i++) {
+        SIM_DMA1_DONE[i] = UINT64_MAX;
+    }
+    SIM_DMA1_TRANSFERS = 0;
+    SIM_DMA1_IRQS = 0;
+}
+
+/**
+ * Handle a DMA controller register write.
+ *
+ * @param periph    The DMA controller description.
+ * @param off       Offset of the written register.
+ */
+static void
+sim_dma_write(const struct sim_periph *periph, size_t off)
+{
+    volatile struct dma *dma = periph->regs;
+    volatile struct dma_ch *ch;
+    size_t i;
+
+    if (off == offsetof(struct dma, ifcr)) {
+        dma->isr &= ~dma->ifcr;
+        dma->ifcr = 0;
+        return;
+    }
+    if (off < offsetof(struct dma, ch)) {
+        return;
+    }
+    i = (off - offsetof(struct dma, ch)) / sizeof(struct dma_ch);
+    ch = &dma->ch[i];
+    if (off != offsetof(struct dma, ch) + i * sizeof(struct dma_ch) +
+               offsetof(struct dma_ch, ccr)) {
+        return;
+    }
+
+    if (!(ch->ccr & DMA_CCR_EN_MASK)) {
+        /* Disabling aborts the transfer */
+        SIM_DMA1_DONE[i] = UINT64_MAX;
+    } else if (SIM_DMA1_DONE[i] == UINT64_MAX && ch->cndtr > 0) {
+        /* Start the transfer, bytes take 8 SPI clocks each */
+        SIM_DMA1_DONE[i] = SIM_TIME +
+            (uint64_t)ch->cndtr * 8 *
+            (2u << ((SIM_SPI1.cr1 & SPI_CR1_BR_MASK) >> SPI_CR1_BR_LSB));
+    }
+}
+
+/**
+ * Get the virtual time of the next transfer completion.
+ *
+ * @param periph    The DMA controller description.
+ *
+ * @return The completion time, or UINT64_MAX if no transfers are active.
+ */
+static uint64_t
+sim_dma_next(const struct sim_periph *periph)
+{
+    size_t i;
+    uint64_t next = UINT64_MAX;
+    (void)periph;
+    for (i = 0; i < SIM_DMA1_CH_NUM; i++) {
+        next = MIN(next, SIM_DMA1_DONE[i]);
+    }
+    return next;
+}
+
+/**
+ * Complete due transfers, and fire their interrupts.
+ *
+ * @param periph    The DMA controller description.
+ */
+static void
+sim_dma_event(const struct sim_periph *periph)
+{
+    volatile struct dma *dma = periph->regs;
+    volatile struct dma_ch *ch;
+    const volatile uint8_t *src;
+    size_t i;
+
+    for (i = 0; i < SIM_DMA1_CH_NUM; i++) {
+        if (SIM_DMA1_DONE[i] > SIM_TIME) {
+            continue;
+        }
+        SIM_DMA1_DONE[i] = UINT64_MAX;
+        ch = &dma->ch[i];
+
+        /* Transfer the data, if it goes from memory to SPI1 */
+        if ((ch->ccr & DMA_CCR_DIR_MASK) &&
+            ch->cpar == (uintptr_t)&SIM_SPI1.dr &&
+            (SIM_SPI1.cr2 & SPI_CR2_TXDMAEN_MASK)) {
+            for (src = (const volatile uint8_t *)ch->cmar;
+                 ch->cndtr > 0; ch->cndtr--) {
+                sim_spi_transfer(&SIM_SPI1, *src);
+                if (ch->ccr & DMA_CCR_MINC_MASK) {
+                    src++;
+                }
+            }
+        }
+        SIM_DMA1_TRANSFERS++;
+
+        /* Signal completion */
+        dma->isr |= DMA_ISR_TCIF_MASK(i + 1) | DMA_ISR_GIF_MASK(i + 1);
+        if ((ch->ccr & DMA_CCR_TCIE_MASK) &&
+            sim_nvic_enabled(NVIC_INT_DMA1_CHANNEL1 + i) &&
+            SIM_DMA1_HANDLER[i] != NULL) {
+            SIM_DMA1_IRQS++;
+            SIM_DMA1_HANDLER[i]();
+        }
+    }
+}
+
+/**
+ * Output DMA controller statistics.
+ *
+ * @param periph    The DMA controller description.
+ * @param stream    The stream to output to.
+ */
+static void
+sim_dma_report(const struct sim_periph *periph, FILE *stream)
+{
+    fprintf(stream, "%s: %" PRIu64 " transfers, %" PRIu64 " interrupts\n",
+            periph->name, SIM_DMA1_TRANSFERS, SIM_DMA1_IRQS);
+}
+
+const struct sim_periph SIM_DMA1_PERIPH = {
+    .name = "dma1",
+    .regs = &SIM_DMA1,
+    .size = sizeof(SIM_DMA1),
+    .init = sim_dma_init,
+    .write = sim_dma_write,
+    .next = sim_dma_next,
+    .event = sim_dma_event,
+    .report = sim_dma_report,
+};
@@ -0,0 +1,74 @@
+/*
+ * Direct memory access controller (DMA) - host stand-in for libstammer
+ */
+
+#ifndef _DMA_H
+#define _DMA_H
+
+#include <stdint.h>
+
+/** DMA channel registers */
+struct dma_ch {
+    uint32_t    ccr;
+    uint32_t    cndtr;
+    /* Address registers are pointer-sized on the host */
+    uintptr_t   cpar;
+    uintptr_t   cmar;
+    uint32_t    reserved;
+};
+
+/** DMA controller registers */
+struct dma {
+    uint32_t        isr;
+    uint32_t        ifcr;
+    struct dma_ch   ch[7];
+};
+
+/* Interrupt status and flag clear registers, for channel N (1-7) */
+#define DMA_ISR_GIF_MASK(_n)    (1 << (((_n) - 1) * 4))
+#define DMA_ISR_TCIF_MASK(_n)   (2 << (((_n) - 1) * 4))
+#define DMA_ISR_HTIF_MASK(_n)   (4 << (((_n) - 1) * 4))
+#define DMA_ISR_TEIF_MASK(_n)   (8 << (((_n) - 1) * 4))
+#define DMA_IFCR_CGIF_MASK(_n)  DMA_ISR_GIF_MASK(_n)
+#define DMA_IFCR_CTCIF_MASK(_n) DMA_ISR_TCIF_MASK(_n)
+#define DMA_IFCR_CHTIF_MASK(_n) DMA_ISR_HTIF_MASK(_n)
+#define DMA_IFCR_CTEIF_MASK(_n) DMA_ISR_TEIF_MASK(_n)
+
+/* Channel configuration register */
+#define DMA_CCR_EN_MASK         (1 << 0)
+#define DMA_CCR_TCIE_MASK       (1 << 1)
+#define DMA_CCR_HTIE_MASK       (1 << 2)
+#define DMA_CCR_TEIE_MASK       (1 << 3)
+#define DMA_CCR_DIR_MASK        (1 << 4)
+#define DMA_CCR_CIRC_MASK       (1 << 5)
+#define DMA_CCR_PINC_MASK       (1 << 6)
+#define DMA_CCR_MINC_MASK       (1 << 7)
+#define DMA_CCR_PSIZE_LSB       8
+#define DMA_CCR_PSIZE_MASK      (3 << DMA_CCR_PSIZE_LSB)
+#define DMA_CCR_MSIZE_LSB       10
+#define DMA_CCR_MSIZE_MASK      (3 << DMA_CCR_MSIZE_LSB)
+enum dma_ccr_size_val {
+    DMA_CCR_SIZE_VAL_8BIT,
+    DMA_CCR_SIZE_VAL_16BIT,
+    DMA_CCR_SIZE_VAL_32BIT
+};
+#define DMA_CCR_PL_LSB          12
+#define DMA_CCR_PL_MASK         (3 << DMA_CCR_PL_LSB)
+enum dma_ccr_pl_val {
+    DMA_CCR_PL_VAL_LOW,
+    DMA_CCR_PL_VAL_MEDIUM,
+    DMA_CCR_PL_VAL_HIGH,
+    DMA_CCR_PL_VAL_VERY_HIGH
+};
+#define DMA_CCR_MEM2MEM_MASK    (1 << 14)
+
+/** Simulated DMA1 registers */
+extern volatile struct dma SIM_DMA1;
+
+/** DMA1 */
+#define DMA1 (&SIM_DMA1)
+
+/** Simulated DMA1 description */
+extern const struct sim_periph SIM_DMA1_PERIPH;
+
+#endif /* _DMA_H */
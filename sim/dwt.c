@@ -0,0 +1,93 @@
+/*
+ * Data watchpoint and trace unit (DWT) - host stand-in for libstammer
+ *
+ * The cycle counter counts host time, scaled to HCLK, as the virtual
+ * time doesn't advance while the firmware runs. Note that the count
+ * includes the time spent in the peripheral models.
+ */
+
+#include "sim.h"
+#include <dwt.h>
+#include <dbg.h>
+#include <time.h>
+
+volatile struct dwt SIM_DWT SIM_MMIO;
+
+volatile struct dbg SIM_DBG SIM_MMIO;
+
+/** Host time of the cycle counter zero, nanoseconds */
+static uint64_t SIM_DWT_ZERO;
+
+/**
+ * Get host time.
+ *
+ * @return Host monotonic time, nanoseconds.
+ */
+static uint64_t
+sim_dwt_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Prepare a DWT register for reading.
+ *
+ * @param periph    The DWT description.
+ * @param off       Offset of the register being read.
+ */
+static void
+sim_dwt_read(const struct sim_periph *periph, size_t off)
+{
+    volatile struct dwt *dwt = periph->regs;
+    if (off == offsetof(struct dwt, cyccnt) &&
+        (dwt->ctrl & DWT_CTRL_CYCCNTENA_MASK) &&
+        (SIM_DBG.demcr & DBG_DEMCR_TRCENA_MASK)) {
+        dwt->cyccnt = (sim_dwt_ns() - SIM_DWT_ZERO) *
+                      (SIM_HCLK_HZ / 1000000) / 1000;
+    }
+}
+
+/**
+ * Handle a DWT register write.
+ *
+ * @param periph    The DWT description.
+ * @param off       Offset of the written register.
+ */
+static void
+sim_dwt_write(const struct sim_periph *periph, size_t off)
+{
+    volatile struct dwt *dwt = periph->regs;
+    if (off == offsetof(struct dwt, cyccnt)) {
+        SIM_DWT_ZERO = sim_dwt_ns() - (uint64_t)dwt->cyccnt * 1000 /
+                                      (SIM_HCLK_HZ / 1000000);
+    }
+}
+
+/**
+ * Reset the DWT.
+ *
+ * @param periph    The DWT description.
+ */
+static void
+sim_dwt_init(const struct sim_periph *periph)
+{
+    (void)periph;
+    SIM_DWT_ZERO = sim_dwt_ns();
+}
+
+const struct sim_periph SIM_DWT_PERIPH = {
+    .name = "dwt",
+    .regs = &SIM_DWT,
+    .size = sizeof(SIM_DWT),
+    .init = sim_dwt_init,
+    .read = sim_dwt_read,
+    .write = sim_dwt_write,
+};
+
+const struct sim_periph SIM_DBG_PERIPH = {
+    .name = "dbg",
+    .regs = &SIM_DBG,
+    .size = sizeof(SIM_DBG),
+};
@@ -0,0 +1,34 @@
+/*
+ * Data watchpoint and trace unit (DWT) - host stand-in for libstammer
+ */
+
+#ifndef _DWT_H
+#define _DWT_H
+
+#include <stdint.h>
+
+/** DWT registers */
+struct dwt {
+    uint32_t ctrl;
+    uint32_t cyccnt;
+    uint32_t cpicnt;
+    uint32_t exccnt;
+    uint32_t sleepcnt;
+    uint32_t lsucnt;
+    uint32_t foldcnt;
+    uint32_t pcsr;
+};
+
+/* Control register */
+#define DWT_CTRL_CYCCNTENA_MASK (1 << 0)
+
+/** Simulated DWT registers */
+extern volatile struct dwt SIM_DWT;
+
+/** DWT */
+#define DWT (&SIM_DWT)
+
+/** Simulated DWT description */
+extern const struct sim_periph SIM_DWT_PERIPH;
+
+#endif /* _DWT_H */
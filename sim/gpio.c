@@ -0,0 +1,83 @@
+/*
+ * General-purpose I/O (GPIO) - host stand-in for libstammer
+ */
+
+#include "sim.h"
+#include "tlc5916.h"
+#include <gpio.h>
+#include <stddef.h>
+
+volatile struct gpio SIM_GPIO_A SIM_MMIO;
+volatile struct gpio SIM_GPIO_B SIM_MMIO;
+volatile struct gpio SIM_GPIO_C SIM_MMIO;
+
+/**
+ * Reset a GPIO port.
+ *
+ * @param periph    The port description.
+ */
+static void
+sim_gpio_init(const struct sim_periph *periph)
+{
+    volatile struct gpio *gpio = periph->regs;
+    /* All pins are floating inputs */
+    gpio->crl = gpio->crh = 0x44444444;
+}
+
+/**
+ * Apply a write to a GPIO port output register.
+ *
+ * @param periph    The port description.
+ * @param off       Offset of the written register.
+ */
+static void
+sim_gpio_write(const struct sim_periph *periph, size_t off)
+{
+    volatile struct gpio *gpio = periph->regs;
+    uint32_t odr = gpio->odr;
+
+    if (off == offsetof(struct gpio, bsrr)) {
+        odr = (odr & ~(gpio->bsrr >> 16)) | (gpio->bsrr & 0xffff);
+        gpio->bsrr = 0;
+    } else if (off == offsetof(struct gpio, brr)) {
+        odr &= ~gpio->brr;
+        gpio->brr = 0;
+    } else if (off != offsetof(struct gpio, odr)) {
+        return;
+    }
+    gpio->odr = odr & 0xffff;
+    gpio->idr = gpio->odr;
+    sim_tlc5916_gpio(gpio);
+}
+
+#define SIM_GPIO_PERIPH(_port) \
+    const struct sim_periph SIM_GPIO_##_port##_PERIPH = {   \
+        .name = "gpio_" #_port,                             \
+        .regs = &SIM_GPIO_##_port,                          \
+        .size = sizeof(SIM_GPIO_##_port),                   \
+        .init = sim_gpio_init,                              \
+        .write = sim_gpio_write,                            \
+    }
+
+SIM_GPIO_PERIPH(A);
+SIM_GPIO_PERIPH(B);
+SIM_GPIO_PERIPH(C);
+
+#undef SIM_GPIO_PERIPH
+
+void
+gpio_pin_conf(volatile struct gpio *gpio, unsigned int pin,
+              enum gpio_mode mode, enum gpio_cnf cnf)
+{
+    volatile uint32_t *cr = pin < 8 ? &gpio->crl : &gpio->crh;
+    unsigned int lsb = (pin & 7) * 4;
+    *cr = (*cr & ~(0xfu << lsb)) | (((cnf << 2) | mode) << lsb);
+    sim_tlc5916_gpio(gpio);
+}
+
+void
+gpio_pin_set(volatile struct gpio *gpio, unsigned int pin, bool set)
+{
+    gpio->bsrr = 1u << (set ? pin : pin + 16);
+    sim_gpio_write(sim_periph_find(gpio), offsetof(struct gpio, bsrr));
+}
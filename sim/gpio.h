@@ -0,0 +1,79 @@
+/*
+ * General-purpose I/O (GPIO) - host stand-in for libstammer
+ */
+
+#ifndef _GPIO_H
+#define _GPIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** GPIO port registers */
+struct gpio {
+    uint32_t crl;
+    uint32_t crh;
+    uint32_t idr;
+    uint32_t odr;
+    uint32_t bsrr;
+    uint32_t brr;
+    uint32_t lckr;
+};
+
+/** Pin mode */
+enum gpio_mode {
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT_10MHZ,
+    GPIO_MODE_OUTPUT_2MHZ,
+    GPIO_MODE_OUTPUT_50MHZ
+};
+
+/** Pin configuration, meaning depends on the mode */
+enum gpio_cnf {
+    /* Input */
+    GPIO_CNF_INPUT_ANALOG = 0,
+    GPIO_CNF_INPUT_FLOATING = 1,
+    GPIO_CNF_INPUT_PULL = 2,
+    /* Output */
+    GPIO_CNF_OUTPUT_GP_PUSH_PULL = 0,
+    GPIO_CNF_OUTPUT_GP_OPEN_DRAIN = 1,
+    GPIO_CNF_OUTPUT_AF_PUSH_PULL = 2,
+    GPIO_CNF_OUTPUT_AF_OPEN_DRAIN = 3
+};
+
+/** Simulated GPIO port registers */
+extern volatile struct gpio SIM_GPIO_A;
+extern volatile struct gpio SIM_GPIO_B;
+extern volatile struct gpio SIM_GPIO_C;
+
+/** GPIO ports */
+#define GPIO_A  (&SIM_GPIO_A)
+#define GPIO_B  (&SIM_GPIO_B)
+#define GPIO_C  (&SIM_GPIO_C)
+
+/** Simulated GPIO port descriptions */
+extern const struct sim_periph SIM_GPIO_A_PERIPH;
+extern const struct sim_periph SIM_GPIO_B_PERIPH;
+extern const struct sim_periph SIM_GPIO_C_PERIPH;
+
+/**
+ * Configure a GPIO pin.
+ *
+ * @param gpio  The GPIO port.
+ * @param pin   The pin number, 0-15.
+ * @param mode  The pin mode.
+ * @param cnf   The pin configuration.
+ */
+extern void gpio_pin_conf(volatile struct gpio *gpio, unsigned int pin,
+                          enum gpio_mode mode, enum gpio_cnf cnf);
+
+/**
+ * Set a GPIO pin output.
+ *
+ * @param gpio  The GPIO port.
+ * @param pin   The pin number, 0-15.
+ * @param set   True to set the pin high, false to set it low.
+ */
+extern void gpio_pin_set(volatile struct gpio *gpio, unsigned int pin,
+                         bool set);
+
+#endif /* _GPIO_H */
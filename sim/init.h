@@ -0,0 +1,15 @@
+/*
+ * Basic initialization - host stand-in for libstammer
+ */
+
+#ifndef _INIT_H
+#define _INIT_H
+
+/**
+ * Initialize the (simulated) board. Sets up the virtual clock and the
+ * peripheral models, and reads the simulation parameters from the
+ * environment.
+ */
+extern void init(void);
+
+#endif /* _INIT_H */
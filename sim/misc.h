@@ -0,0 +1,17 @@
+/*
+ * Miscellaneous definitions - host stand-in for libstammer
+ */
+
+#ifndef _MISC_H
+#define _MISC_H
+
+/** Get number of elements in an array */
+#define ARRAY_SIZE(_a) (sizeof(_a) / sizeof((_a)[0]))
+
+/** Get minimum of two values */
+#define MIN(_a, _b) ((_a) < (_b) ? (_a) : (_b))
+
+/** Get maximum of two values */
+#define MAX(_a, _b) ((_a) > (_b) ? (_a) : (_b))
+
+#endif /* _MISC_H */
@@ -0,0 +1,131 @@
+/*
+ * Simulated memory-mapped I/O
+ *
+ * Firmware objects are compiled with GCC's ThreadSanitizer instrumentation
+ * (-fsanitize=thread), but instead of linking the sanitizer runtime we
+ * provide the hooks it calls here. With the "tsan-distinguish-volatile"
+ * parameter all peripheral register accesses go through the
+ * __tsan_volatile_* hooks, which are called right before the access.
+ *
+ * Reads are passed to the owning peripheral model immediately, so it can
+ * update the register value. Writes are remembered and delivered on the
+ * next access, or the next sim_mmio_sync() call, when the written value is
+ * already in memory.
+ */
+
+#include "sim.h"
+
+/** Start of the simulated register blocks (provided by the linker) */
+extern volatile char __start_sim_mmio[];
+/** End of the simulated register blocks (provided by the linker) */
+extern volatile char __stop_sim_mmio[];
+
+/** Register written by firmware, but not yet delivered to the model */
+static volatile void *SIM_MMIO_WRITE = NULL;
+
+/**
+ * Check if an address belongs to a simulated register block.
+ *
+ * @param addr  The address to check.
+ *
+ * @return True if the address is a register, false otherwise.
+ */
+static inline bool
+sim_mmio_is_reg(const volatile void *addr)
+{
+    return (const volatile char *)addr >= __start_sim_mmio &&
+           (const volatile char *)addr < __stop_sim_mmio;
+}
+
+void
+sim_mmio_sync(void)
+{
+    volatile void *addr = SIM_MMIO_WRITE;
+    const struct sim_periph *periph;
+
+    if (addr == NULL) {
+        return;
+    }
+    SIM_MMIO_WRITE = NULL;
+    periph = sim_periph_find(addr);
+    if (periph != NULL && periph->write != NULL) {
+        periph->write(periph, (volatile char *)addr -
+                              (volatile char *)periph->regs);
+    }
+}
+
+/**
+ * Handle a firmware volatile read, before it happens.
+ *
+ * @param addr  The address being read.
+ */
+static void
+sim_mmio_read(volatile void *addr)
+{
+    const struct sim_periph *periph;
+
+    sim_mmio_sync();
+    if (sim_mmio_is_reg(addr)) {
+        periph = sim_periph_find(addr);
+        if (periph != NULL && periph->read != NULL) {
+            periph->read(periph, (volatile char *)addr -
+                                 (volatile char *)periph->regs);
+        }
+    }
+}
+
+/**
+ * Handle a firmware volatile write, before it happens.
+ *
+ * @param addr  The address being written.
+ */
+static void
+sim_mmio_write(volatile void *addr)
+{
+    sim_mmio_sync();
+    if (sim_mmio_is_reg(addr)) {
+        SIM_MMIO_WRITE = addr;
+    }
+}
+
+/*
+ * Instrumentation hooks
+ */
+
+void __tsan_init(void);
+void
+__tsan_init(void)
+{
+}
+
+#define SIM_MMIO_HOOKS(_size) \
+    void __tsan_read##_size(void *addr);                                \
+    void __tsan_read##_size(void *addr) { (void)addr; }                 \
+    void __tsan_write##_size(void *addr);                               \
+    void __tsan_write##_size(void *addr) { (void)addr; }                \
+    void __tsan_unaligned_read##_size(void *addr);                      \
+    void __tsan_unaligned_read##_size(void *addr) { (void)addr; }       \
+    void __tsan_unaligned_write##_size(void *addr);                     \
+    void __tsan_unaligned_write##_size(void *addr) { (void)addr; }      \
+    void __tsan_volatile_read##_size(volatile void *addr);              \
+    void __tsan_volatile_read##_size(volatile void *addr)               \
+    { sim_mmio_read(addr); }                                            \
+    void __tsan_volatile_write##_size(volatile void *addr);             \
+    void __tsan_volatile_write##_size(volatile void *addr)              \
+    { sim_mmio_write(addr); }
+
+SIM_MMIO_HOOKS(1)
+SIM_MMIO_HOOKS(2)
+SIM_MMIO_HOOKS(4)
+SIM_MMIO_HOOKS(8)
+SIM_MMIO_HOOKS(16)
+
+#undef SIM_MMIO_HOOKS
+
+/* Accesses of other sizes, merged by the compiler, never to registers */
+void __tsan_read_range(void *addr, unsigned long size);
+void __tsan_read_range(void *addr, unsigned long size)
+{ (void)addr; (void)size; }
+void __tsan_write_range(void *addr, unsigned long size);
+void __tsan_write_range(void *addr, unsigned long size)
+{ (void)addr; (void)size; }
@@ -0,0 +1,69 @@
+/*
+ * Nested vectored interrupt controller (NVIC) - host stand-in for
+ * libstammer
+ *
+ * Only tracks which interrupts are enabled, for the peripheral models to
+ * check before calling the handlers.
+ */
+
+#include "sim.h"
+#include <nvic.h>
+#include <string.h>
+
+volatile struct nvic SIM_NVIC SIM_MMIO;
+
+/** Interrupt enable bits */
+static uint32_t SIM_NVIC_ENABLED[8];
+
+bool
+sim_nvic_enabled(unsigned int num)
+{
+    return (SIM_NVIC_ENABLED[num >> 5] >> (num & 0x1f)) & 1;
+}
+
+/**
+ * Reset the NVIC.
+ *
+ * @param periph    The NVIC description.
+ */
+static void
+sim_nvic_init(const struct sim_periph *periph)
+{
+    (void)periph;
+    memset(SIM_NVIC_ENABLED, 0, sizeof(SIM_NVIC_ENABLED));
+}
+
+/**
+ * Handle an NVIC register write.
+ *
+ * @param periph    The NVIC description.
+ * @param off       Offset of the written register.
+ */
+static void
+sim_nvic_write(const struct sim_periph *periph, size_t off)
+{
+    volatile struct nvic *nvic = periph->regs;
+    size_t i;
+
+    /* The set-enable registers are at the start */
+    if (off < offsetof(struct nvic, reserved0)) {
+        i = (off - offsetof(struct nvic, iser)) / sizeof(uint32_t);
+        SIM_NVIC_ENABLED[i] |= nvic->iser[i];
+    } else if (off >= offsetof(struct nvic, icer) &&
+               off < offsetof(struct nvic, reserved1)) {
+        i = (off - offsetof(struct nvic, icer)) / sizeof(uint32_t);
+        SIM_NVIC_ENABLED[i] &= ~nvic->icer[i];
+    } else {
+        return;
+    }
+    /* Both set and clear registers read back the enable bits */
+    nvic->iser[i] = nvic->icer[i] = SIM_NVIC_ENABLED[i];
+}
+
+const struct sim_periph SIM_NVIC_PERIPH = {
+    .name = "nvic",
+    .regs = &SIM_NVIC,
+    .size = sizeof(SIM_NVIC),
+    .init = sim_nvic_init,
+    .write = sim_nvic_write,
+};
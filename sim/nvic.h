@@ -0,0 +1,71 @@
+/*
+ * Nested vectored interrupt controller (NVIC) - host stand-in for
+ * libstammer
+ */
+
+#ifndef _NVIC_H
+#define _NVIC_H
+
+#include <stdint.h>
+
+/** NVIC registers */
+struct nvic {
+    uint32_t iser[8];
+    uint32_t reserved0[24];
+    uint32_t icer[8];
+    uint32_t reserved1[24];
+    uint32_t ispr[8];
+    uint32_t reserved2[24];
+    uint32_t icpr[8];
+    uint32_t reserved3[24];
+    uint32_t iabr[8];
+    uint32_t reserved4[56];
+    uint8_t  ip[240];
+};
+
+/** Interrupt numbers */
+enum nvic_int {
+    NVIC_INT_DMA1_CHANNEL1 = 11,
+    NVIC_INT_DMA1_CHANNEL2 = 12,
+    NVIC_INT_DMA1_CHANNEL3 = 13,
+    NVIC_INT_DMA1_CHANNEL4 = 14,
+    NVIC_INT_DMA1_CHANNEL5 = 15,
+    NVIC_INT_DMA1_CHANNEL6 = 16,
+    NVIC_INT_DMA1_CHANNEL7 = 17,
+    NVIC_INT_TIM2 = 28,
+    NVIC_INT_TIM3 = 29,
+    NVIC_INT_TIM4 = 30,
+};
+
+/** Simulated NVIC registers */
+extern volatile struct nvic SIM_NVIC;
+
+/** NVIC */
+#define NVIC (&SIM_NVIC)
+
+/** Simulated NVIC description */
+extern const struct sim_periph SIM_NVIC_PERIPH;
+
+/**
+ * Enable an interrupt.
+ *
+ * @param num   The interrupt number.
+ */
+static inline void
+nvic_int_enable(enum nvic_int num)
+{
+    NVIC->iser[num >> 5] = 1 << (num & 0x1f);
+}
+
+/**
+ * Disable an interrupt.
+ *
+ * @param num   The interrupt number.
+ */
+static inline void
+nvic_int_disable(enum nvic_int num)
+{
+    NVIC->icer[num >> 5] = 1 << (num & 0x1f);
+}
+
+#endif /* _NVIC_H */
@@ -0,0 +1,27 @@
+/*
+ * Pseudo-random number generator - host stand-in for libstammer
+ *
+ * This is a plain xorshift32, so the sequence doesn't match the one on the
+ * target, but is stable for any given seed.
+ */
+
+#include <prng.h>
+
+/** Current generator state, never zero */
+static uint32_t PRNG_STATE = 2463534242;
+
+void
+prng_seed(uint32_t seed)
+{
+    PRNG_STATE = seed ? seed : 2463534242;
+}
+
+uint32_t
+prng_next(void)
+{
+    uint32_t x = PRNG_STATE;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return (PRNG_STATE = x);
+}
@@ -0,0 +1,24 @@
+/*
+ * Pseudo-random number generator - host stand-in for libstammer
+ */
+
+#ifndef _PRNG_H
+#define _PRNG_H
+
+#include <stdint.h>
+
+/**
+ * Seed the pseudo-random number generator.
+ *
+ * @param seed  The seed to use.
+ */
+extern void prng_seed(uint32_t seed);
+
+/**
+ * Get the next pseudo-random number.
+ *
+ * @return The next pseudo-random number.
+ */
+extern uint32_t prng_next(void);
+
+#endif /* _PRNG_H */
@@ -0,0 +1,14 @@
+/*
+ * Reset and clock control (RCC) - host stand-in for libstammer
+ */
+
+#include "sim.h"
+#include <rcc.h>
+
+volatile struct rcc SIM_RCC SIM_MMIO;
+
+const struct sim_periph SIM_RCC_PERIPH = {
+    .name = "rcc",
+    .regs = &SIM_RCC,
+    .size = sizeof(SIM_RCC),
+};
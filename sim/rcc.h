@@ -0,0 +1,59 @@
+/*
+ * Reset and clock control (RCC) - host stand-in for libstammer
+ */
+
+#ifndef _RCC_H
+#define _RCC_H
+
+#include <stdint.h>
+
+/** RCC registers */
+struct rcc {
+    uint32_t cr;
+    uint32_t cfgr;
+    uint32_t cir;
+    uint32_t apb2rstr;
+    uint32_t apb1rstr;
+    uint32_t ahbenr;
+    uint32_t apb2enr;
+    uint32_t apb1enr;
+    uint32_t bdcr;
+    uint32_t csr;
+};
+
+/* ADC prescaler */
+#define RCC_CFGR_ADCPRE_LSB     14
+#define RCC_CFGR_ADCPRE_MASK    (3 << RCC_CFGR_ADCPRE_LSB)
+enum rcc_cfgr_adcpre_val {
+    RCC_CFGR_ADCPRE_VAL_PCLK2_DIV2,
+    RCC_CFGR_ADCPRE_VAL_PCLK2_DIV4,
+    RCC_CFGR_ADCPRE_VAL_PCLK2_DIV6,
+    RCC_CFGR_ADCPRE_VAL_PCLK2_DIV8
+};
+
+/* AHB peripheral clock enable */
+#define RCC_AHBENR_DMA1EN_MASK  (1 << 0)
+
+/* APB2 peripheral clock enable */
+#define RCC_APB2ENR_AFIOEN_MASK (1 << 0)
+#define RCC_APB2ENR_IOPAEN_MASK (1 << 2)
+#define RCC_APB2ENR_IOPBEN_MASK (1 << 3)
+#define RCC_APB2ENR_IOPCEN_MASK (1 << 4)
+#define RCC_APB2ENR_ADC1EN_MASK (1 << 9)
+#define RCC_APB2ENR_SPI1EN_MASK (1 << 12)
+
+/* APB1 peripheral clock enable */
+#define RCC_APB1ENR_TIM2EN_MASK (1 << 0)
+#define RCC_APB1ENR_TIM3EN_MASK (1 << 1)
+#define RCC_APB1ENR_TIM4EN_MASK (1 << 2)
+
+/** Simulated RCC registers */
+extern volatile struct rcc SIM_RCC;
+
+/** RCC */
+#define RCC (&SIM_RCC)
+
+/** Simulated RCC description */
+extern const struct sim_periph SIM_RCC_PERIPH;
+
+#endif /* _RCC_H */
@@ -0,0 +1,146 @@
+/*
+ * Simulated Blue Pill board
+ */
+
+#include "sim.h"
+#include "rcc.h"
+#include "gpio.h"
+#include "spi.h"
+#include "stk.h"
+#include "adc.h"
+#include "tim.h"
+#include "dwt.h"
+#include "dbg.h"
+#include "nvic.h"
+#include "dma.h"
+#include "tlc5916.h"
+#include "trace.h"
+#include <init.h>
+#include <misc.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+uint64_t SIM_TIME = 0;
+
+uint32_t SIM_SEED = 0;
+
+/** Virtual time at which the simulation ends, HCLK cycles */
+static uint64_t SIM_TIME_END;
+
+/** List of simulated peripherals and board devices */
+static const struct sim_periph *const SIM_PERIPH_LIST[] = {
+    &SIM_RCC_PERIPH,
+    &SIM_GPIO_A_PERIPH,
+    &SIM_GPIO_B_PERIPH,
+    &SIM_GPIO_C_PERIPH,
+    &SIM_SPI1_PERIPH,
+    &SIM_STK_PERIPH,
+    &SIM_ADC1_PERIPH,
+    &SIM_TIM2_PERIPH,
+    &SIM_DWT_PERIPH,
+    &SIM_DBG_PERIPH,
+    &SIM_NVIC_PERIPH,
+    &SIM_DMA1_PERIPH,
+    &SIM_TLC5916_PERIPH,
+    &SIM_TRACE_PERIPH,
+};
+
+const struct sim_periph *
+sim_periph_find(const volatile void *addr)
+{
+    size_t i;
+    const struct sim_periph *periph;
+
+    for (i = 0; i < ARRAY_SIZE(SIM_PERIPH_LIST); i++) {
+        periph = SIM_PERIPH_LIST[i];
+        if ((const volatile char *)addr >=
+                (const volatile char *)periph->regs &&
+            (const volatile char *)addr <
+                (const volatile char *)periph->regs + periph->size) {
+            return periph;
+        }
+    }
+    return NULL;
+}
+
+/** Output simulation statistics on exit */
+static void
+sim_report(void)
+{
+    size_t i;
+    const struct sim_periph *periph;
+
+    sim_mmio_sync();
+    fprintf(stderr, "sim: %.6f s simulated, seed %" PRIu32 "\n",
+            (double)SIM_TIME / SIM_HCLK_HZ, SIM_SEED);
+    for (i = 0; i < ARRAY_SIZE(SIM_PERIPH_LIST); i++) {
+        periph = SIM_PERIPH_LIST[i];
+        if (periph->report != NULL) {
+            periph->report(periph, stderr);
+        }
+    }
+}
+
+void
+init(void)
+{
+    const char *str;
+    size_t i;
+    const struct sim_periph *periph;
+
+    /* Read simulation duration, seconds */
+    str = getenv("SIM_TIME");
+    SIM_TIME_END = (uint64_t)((str == NULL ? 10 : atof(str)) * SIM_HCLK_HZ);
+
+    /* Read the seed */
+    str = getenv("SIM_SEED");
+    SIM_SEED = str == NULL ? 0 : strtoul(str, NULL, 0);
+
+    /* Reset the devices */
+    for (i = 0; i < ARRAY_SIZE(SIM_PERIPH_LIST); i++) {
+        periph = SIM_PERIPH_LIST[i];
+        if (periph->init != NULL) {
+            periph->init(periph);
+        }
+    }
+
+    atexit(sim_report);
+}
+
+void
+sim_wfi(void)
+{
+    size_t i;
+    const struct sim_periph *periph;
+    const struct sim_periph *next_periph = NULL;
+    uint64_t time;
+    uint64_t next_time = UINT64_MAX;
+
+    sim_mmio_sync();
+
+    /* Find the earliest event */
+    for (i = 0; i < ARRAY_SIZE(SIM_PERIPH_LIST); i++) {
+        periph = SIM_PERIPH_LIST[i];
+        if (periph->next != NULL) {
+            time = periph->next(periph);
+            if (time < next_time) {
+                next_time = time;
+                next_periph = periph;
+            }
+        }
+    }
+
+    if (next_periph == NULL) {
+        fprintf(stderr, "sim: waiting for interrupt with none enabled\n");
+        exit(1);
+    }
+    if (next_time >= SIM_TIME_END) {
+        SIM_TIME = SIM_TIME_END;
+        exit(0);
+    }
+
+    /* Advance the time and handle the event */
+    SIM_TIME = MAX(SIM_TIME, next_time);
+    next_periph->event(next_periph);
+    sim_mmio_sync();
+}
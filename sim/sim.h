@@ -0,0 +1,125 @@
+/*
+ * Simulated Blue Pill board
+ *
+ * The simulator runs the firmware natively on the host against a virtual
+ * HCLK. Peripheral registers are plain memory, and firmware objects are
+ * compiled with access instrumentation, so the peripheral models get a
+ * chance to react to every register read and write (see mmio.c).
+ * Interrupt handlers are called from sim_wfi(), at the virtual time their
+ * interrupts fire. Firmware code itself runs in zero virtual time.
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Simulated HCLK frequency, Hz */
+#define SIM_HCLK_HZ     72000000
+
+/** Put a simulated peripheral register block into the MMIO section */
+#define SIM_MMIO        __attribute__ ((section ("sim_mmio")))
+
+/** Simulated peripheral (or board device) description */
+struct sim_periph {
+    /** Name, for reports */
+    const char     *name;
+    /** Register block, or NULL if the device has no registers */
+    volatile void  *regs;
+    /** Size of the register block, bytes */
+    size_t          size;
+    /** Reset the device state, or NULL */
+    void          (*init)(const struct sim_periph *periph);
+    /**
+     * Prepare a register for a firmware read, or NULL.
+     * Called before the read happens.
+     */
+    void          (*read)(const struct sim_periph *periph, size_t off);
+    /**
+     * Handle a firmware write to a register, or NULL.
+     * Called after the written value is in the register.
+     */
+    void          (*write)(const struct sim_periph *periph, size_t off);
+    /** Get virtual time of the next event, or NULL for no events */
+    uint64_t      (*next)(const struct sim_periph *periph);
+    /** Handle the event due at current virtual time */
+    void          (*event)(const struct sim_periph *periph);
+    /** Output the device statistics, or NULL */
+    void          (*report)(const struct sim_periph *periph, FILE *stream);
+};
+
+/** Current virtual time, HCLK cycles */
+extern uint64_t SIM_TIME;
+
+/** Simulation seed, fed to the firmware via the ADC */
+extern uint32_t SIM_SEED;
+
+/**
+ * Find the simulated peripheral owning a register address.
+ *
+ * @param addr  The register address.
+ *
+ * @return The peripheral, or NULL if not found.
+ */
+extern const struct sim_periph *sim_periph_find(const volatile void *addr);
+
+/**
+ * Deliver any firmware register write not yet seen by the peripheral
+ * models.
+ */
+extern void sim_mmio_sync(void);
+
+/**
+ * Wait for interrupt: advance the virtual time to the next event, and
+ * handle it, calling the interrupt handler, if any. Exit the simulation
+ * when the time runs out.
+ */
+extern void sim_wfi(void);
+
+/**
+ * Check if an interrupt is enabled in the simulated NVIC.
+ *
+ * @param num   The interrupt number.
+ *
+ * @return True if the interrupt is enabled, false otherwise.
+ */
+extern bool sim_nvic_enabled(unsigned int num);
+
+struct spi;
+
+/**
+ * Transfer a byte through simulated SPI, in master mode.
+ *
+ * @param spi   The SPI registers.
+ * @param byte  The byte to transmit.
+ */
+extern void sim_spi_transfer(volatile struct spi *spi, uint8_t byte);
+
+/**
+ * Trace a PWM bank swap, see trace.h.
+ *
+ * @param br        The LED brightness array.
+ * @param br_num    Number of entries in the brightness array.
+ * @param bank      The bank swapped in.
+ * @param bank_size Size of the bank, bytes.
+ */
+extern void sim_trace_swap(const uint8_t *br, size_t br_num,
+                           const volatile void *bank, size_t bank_size);
+
+/*
+ * Firmware interrupt handlers, NULL if not defined
+ */
+extern void systick_handler(void) __attribute__ ((weak));
+extern void tim2_handler(void) __attribute__ ((weak));
+extern void dma1_channel1_handler(void) __attribute__ ((weak));
+extern void dma1_channel2_handler(void) __attribute__ ((weak));
+extern void dma1_channel3_handler(void) __attribute__ ((weak));
+extern void dma1_channel4_handler(void) __attribute__ ((weak));
+extern void dma1_channel5_handler(void) __attribute__ ((weak));
+extern void dma1_channel6_handler(void) __attribute__ ((weak));
+extern void dma1_channel7_handler(void) __attribute__ ((weak));
+
+#endif /* _SIM_H */
@@ -0,0 +1,98 @@
+/*
+ * Serial peripheral interface (SPI) - host stand-in for libstammer
+ *
+ * Transfers complete instantly, with the data shifted through the simulated
+ * TLC5916 chain.
+ */
+
+#include "sim.h"
+#include "tlc5916.h"
+#include <spi.h>
+#include <inttypes.h>
+
+volatile struct spi SIM_SPI1 SIM_MMIO;
+
+/** Number of bytes transferred */
+static uint64_t SIM_SPI1_BYTES;
+
+/**
+ * Reset SPI.
+ *
+ * @param periph    The SPI description.
+ */
+static void
+sim_spi_init(const struct sim_periph *periph)
+{
+    volatile struct spi *spi = periph->regs;
+    spi->sr = SPI_SR_TXE_MASK;
+    SIM_SPI1_BYTES = 0;
+}
+
+/**
+ * Prepare an SPI register for reading.
+ *
+ * @param periph    The SPI description.
+ * @param off       Offset of the register being read.
+ */
+static void
+sim_spi_read(const struct sim_periph *periph, size_t off)
+{
+    volatile struct spi *spi = periph->regs;
+    /* Reading the data register consumes the received byte */
+    if (off == offsetof(struct spi, dr)) {
+        spi->sr &= ~SPI_SR_RXNE_MASK;
+    }
+}
+
+void
+sim_spi_transfer(volatile struct spi *spi, uint8_t byte)
+{
+    if ((spi->cr1 & (SPI_CR1_SPE_MASK | SPI_CR1_MSTR_MASK)) !=
+            (SPI_CR1_SPE_MASK | SPI_CR1_MSTR_MASK)) {
+        return;
+    }
+    spi->dr = sim_tlc5916_shift(byte);
+    if (spi->sr & SPI_SR_RXNE_MASK) {
+        spi->sr |= SPI_SR_OVR_MASK;
+    }
+    spi->sr |= SPI_SR_RXNE_MASK | SPI_SR_TXE_MASK;
+    SIM_SPI1_BYTES++;
+}
+
+/**
+ * Handle an SPI register write.
+ *
+ * @param periph    The SPI description.
+ * @param off       Offset of the written register.
+ */
+static void
+sim_spi_write(const struct sim_periph *periph, size_t off)
+{
+    volatile struct spi *spi = periph->regs;
+    if (off == offsetof(struct spi, dr)) {
+        sim_spi_transfer(spi, spi->dr);
+    }
+}
+
+/**
+ * Output SPI statistics.
+ *
+ * @param periph    The SPI description.
+ * @param stream    The stream to output to.
+ */
+static void
+sim_spi_report(const struct sim_periph *periph, FILE *stream)
+{
+    fprintf(stream, "%s: %" PRIu64 " bytes transferred\n",
+            periph->name, SIM_SPI1_BYTES);
+}
+
+const struct sim_periph SIM_SPI1_PERIPH = {
+    .name = "spi1",
+    .regs = &SIM_SPI1,
+    .size = sizeof(SIM_SPI1),
+    .init = sim_spi_init,
+    .read = sim_spi_read,
+    .write = sim_spi_write,
+    .report = sim_spi_report,
+};
@@ -0,0 +1,65 @@
+/*
+ * Serial peripheral interface (SPI) - host stand-in for libstammer
+ */
+
+#ifndef _SPI_H
+#define _SPI_H
+
+#include <stdint.h>
+
+/** SPI registers */
+struct spi {
+    uint32_t cr1;
+    uint32_t cr2;
+    uint32_t sr;
+    uint32_t dr;
+    uint32_t crcpr;
+    uint32_t rxcrcr;
+    uint32_t txcrcr;
+    uint32_t i2scfgr;
+    uint32_t i2spr;
+};
+
+/* Control register 1 */
+#define SPI_CR1_MSTR_LSB    2
+#define SPI_CR1_MSTR_MASK   (1 << SPI_CR1_MSTR_LSB)
+enum spi_cr1_mstr_val {
+    SPI_CR1_MSTR_VAL_SLAVE,
+    SPI_CR1_MSTR_VAL_MASTER
+};
+#define SPI_CR1_BR_LSB      3
+#define SPI_CR1_BR_MASK     (7 << SPI_CR1_BR_LSB)
+enum spi_cr1_br_val {
+    SPI_CR1_BR_VAL_FPCLK_DIV2,
+    SPI_CR1_BR_VAL_FPCLK_DIV4,
+    SPI_CR1_BR_VAL_FPCLK_DIV8,
+    SPI_CR1_BR_VAL_FPCLK_DIV16,
+    SPI_CR1_BR_VAL_FPCLK_DIV32,
+    SPI_CR1_BR_VAL_FPCLK_DIV64,
+    SPI_CR1_BR_VAL_FPCLK_DIV128,
+    SPI_CR1_BR_VAL_FPCLK_DIV256
+};
+#define SPI_CR1_SPE_MASK    (1 << 6)
+#define SPI_CR1_SSI_MASK    (1 << 8)
+#define SPI_CR1_SSM_MASK    (1 << 9)
+
+/* Control register 2 */
+#define SPI_CR2_RXDMAEN_MASK    (1 << 0)
+#define SPI_CR2_TXDMAEN_MASK    (1 << 1)
+
+/* Status register */
+#define SPI_SR_RXNE_MASK    (1 << 0)
+#define SPI_SR_TXE_MASK     (1 << 1)
+#define SPI_SR_OVR_MASK     (1 << 6)
+#define SPI_SR_BSY_MASK     (1 << 7)
+
+/** Simulated SPI1 registers */
+extern volatile struct spi SIM_SPI1;
+
+/** SPI1 */
+#define SPI1 (&SIM_SPI1)
+
+/** Simulated SPI1 description */
+extern const struct sim_periph SIM_SPI1_PERIPH;
+
+#endif /* _SPI_H */
@@ -0,0 +1,139 @@
+/*
+ * SysTick timer (STK) - host stand-in for libstammer
+ */
+
+#include "sim.h"
+#include <stk.h>
+#include <inttypes.h>
+
+volatile struct stk SIM_STK SIM_MMIO;
+
+/** Virtual time the counter reaches zero next, if enabled */
+static uint64_t SIM_STK_ZERO;
+
+/** Number of interrupts fired */
+static uint64_t SIM_STK_IRQS;
+
+/**
+ * Get the number of HCLK cycles per SysTick counter cycle.
+ *
+ * @param stk   The SysTick registers.
+ *
+ * @return The number of HCLK cycles.
+ */
+static uint64_t
+sim_stk_div(volatile struct stk *stk)
+{
+    return (stk->ctrl & STK_CTRL_CLKSOURCE_MASK) ? 1 : 8;
+}
+
+/**
+ * Reset SysTick.
+ *
+ * @param periph    The SysTick description.
+ */
+static void
+sim_stk_init(const struct sim_periph *periph)
+{
+    (void)periph;
+    SIM_STK_ZERO = 0;
+    SIM_STK_IRQS = 0;
+}
+
+/**
+ * Prepare a SysTick register for reading.
+ *
+ * @param periph    The SysTick description.
+ * @param off       Offset of the register being read.
+ */
+static void
+sim_stk_read(const struct sim_periph *periph, size_t off)
+{
+    volatile struct stk *stk = periph->regs;
+    if (off == offsetof(struct stk, val) &&
+        (stk->ctrl & STK_CTRL_ENABLE_MASK)) {
+        stk->val = (SIM_STK_ZERO - SIM_TIME) / sim_stk_div(stk);
+    }
+}
+
+/**
+ * Handle a SysTick register write.
+ *
+ * @param periph    The SysTick description.
+ * @param off       Offset of the written register.
+ */
+static void
+sim_stk_write(const struct sim_periph *periph, size_t off)
+{
+    volatile struct stk *stk = periph->regs;
+
+    if (off == offsetof(struct stk, val)) {
+        /* Writing clears the counter, it reloads on the next cycle */
+        stk->val = 0;
+        SIM_STK_ZERO = SIM_TIME + ((uint64_t)stk->load + 1) *
+                                  sim_stk_div(stk);
+    } else if (off == offsetof(struct stk, ctrl)) {
+        SIM_STK_ZERO = SIM_TIME + (stk->val == 0
+                                    ? (uint64_t)stk->load + 1
+                                    : stk->val) * sim_stk_div(stk);
+    }
+}
+
+/**
+ * Get the virtual time of the next SysTick interrupt.
+ *
+ * @param periph    The SysTick description.
+ *
+ * @return The time of the next interrupt, or UINT64_MAX if disabled.
+ */
+static uint64_t
+sim_stk_next(const struct sim_periph *periph)
+{
+    volatile struct stk *stk = periph->regs;
+    return ((stk->ctrl & (STK_CTRL_ENABLE_MASK | STK_CTRL_TICKINT_MASK)) ==
+            (STK_CTRL_ENABLE_MASK | STK_CTRL_TICKINT_MASK))
+                ? SIM_STK_ZERO : UINT64_MAX;
+}
+
+/**
+ * Reload the counter and fire the SysTick interrupt.
+ *
+ * @param periph    The SysTick description.
+ */
+static void
+sim_stk_event(const struct sim_periph *periph)
+{
+    volatile struct stk *stk = periph->regs;
+    /* The counter reloads before the handler gets a chance to run */
+    SIM_STK_ZERO += ((uint64_t)stk->load + 1) * sim_stk_div(stk);
+    stk->ctrl |= STK_CTRL_COUNTFLAG_MASK;
+    if (systick_handler != NULL) {
+        SIM_STK_IRQS++;
+        systick_handler();
+    }
+}
+
+/**
+ * Output SysTick statistics.
+ *
+ * @param periph    The SysTick description.
+ * @param stream    The stream to output to.
+ */
+static void
+sim_stk_report(const struct sim_periph *periph, FILE *stream)
+{
+    fprintf(stream, "%s: %" PRIu64 " interrupts\n",
+            periph->name, SIM_STK_IRQS);
+}
+
+const struct sim_periph SIM_STK_PERIPH = {
+    .name = "stk",
+    .regs = &SIM_STK,
+    .size = sizeof(SIM_STK),
+    .init = sim_stk_init,
+    .read = sim_stk_read,
+    .write = sim_stk_write,
+    .next = sim_stk_next,
+    .event = sim_stk_event,
+    .report = sim_stk_report,
+};
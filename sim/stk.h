@@ -0,0 +1,38 @@
+/*
+ * SysTick timer (STK) - host stand-in for libstammer
+ */
+
+#ifndef _STK_H
+#define _STK_H
+
+#include <stdint.h>
+
+/** SysTick registers */
+struct stk {
+    uint32_t ctrl;
+    uint32_t load;
+    uint32_t val;
+    uint32_t calib;
+};
+
+/* Control and status register */
+#define STK_CTRL_ENABLE_MASK        (1 << 0)
+#define STK_CTRL_TICKINT_MASK       (1 << 1)
+#define STK_CTRL_CLKSOURCE_LSB      2
+#define STK_CTRL_CLKSOURCE_MASK     (1 << STK_CTRL_CLKSOURCE_LSB)
+enum stk_ctrl_clksource_val {
+    STK_CTRL_CLKSOURCE_VAL_AHB_DIV8,
+    STK_CTRL_CLKSOURCE_VAL_AHB
+};
+#define STK_CTRL_COUNTFLAG_MASK     (1 << 16)
+
+/** Simulated SysTick registers */
+extern volatile struct stk SIM_STK;
+
+/** SysTick */
+#define STK (&SIM_STK)
+
+/** Simulated SysTick description */
+extern const struct sim_periph SIM_STK_PERIPH;
+
+#endif /* _STK_H */
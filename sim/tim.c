@@ -0,0 +1,271 @@
+/*
+ * General-purpose timers (TIM2-TIM4) - host stand-in for libstammer
+ *
+ * Only TIM2 is simulated, counting up at HCLK divided by the prescaler,
+ * and firing the update and capture/compare interrupts. The status flags
+ * are only set for the enabled interrupts. Prescaler and auto-reload
+ * changes take effect immediately.
+ */
+
+#include "sim.h"
+#include <tim.h>
+#include <nvic.h>
+#include <misc.h>
+#include <inttypes.h>
+
+volatile struct tim SIM_TIM2 SIM_MMIO;
+
+/** Virtual time the counter was (or would be) zero, if enabled */
+static uint64_t SIM_TIM2_BASE;
+
+/** Number of counts since SIM_TIM2_BASE the last event was handled at */
+static uint64_t SIM_TIM2_LAST;
+
+/** Status register value, its bits can only be cleared by firmware */
+static uint32_t SIM_TIM2_SR;
+
+/** Number of interrupts fired */
+static uint64_t SIM_TIM2_IRQS;
+
+/**
+ * Get the number of HCLK cycles per timer count.
+ *
+ * @param tim   The timer registers.
+ *
+ * @return The number of HCLK cycles.
+ */
+static uint64_t
+sim_tim_div(volatile struct tim *tim)
+{
+    return (uint64_t)(tim->psc & 0xffff) + 1;
+}
+
+/**
+ * Get the number of counts since the counter base, at current time.
+ *
+ * @param tim   The timer registers.
+ *
+ * @return The number of counts.
+ */
+static uint64_t
+sim_tim_counts(volatile struct tim *tim)
+{
+    return (SIM_TIME - SIM_TIM2_BASE) / sim_tim_div(tim);
+}
+
+/**
+ * Set the counter value, and continue counting from it at current time.
+ *
+ * @param tim   The timer registers.
+ * @param cnt   The counter value.
+ */
+static void
+sim_tim_rebase(volatile struct tim *tim, uint32_t cnt)
+{
+    tim->cnt = cnt;
+    SIM_TIM2_BASE = SIM_TIME - (uint64_t)cnt * sim_tim_div(tim);
+    SIM_TIM2_LAST = cnt;
+}
+
+/**
+ * Reset the timer.
+ *
+ * @param periph    The timer description.
+ */
+static void
+sim_tim_init(const struct sim_periph *periph)
+{
+    volatile struct tim *tim = periph->regs;
+    tim->arr = 0xffff;
+    SIM_TIM2_BASE = 0;
+    SIM_TIM2_LAST = 0;
+    SIM_TIM2_SR = 0;
+    SIM_TIM2_IRQS = 0;
+}
+
+/**
+ * Prepare a timer register for reading.
+ *
+ * @param periph    The timer description.
+ * @param off       Offset of the register being read.
+ */
+static void
+sim_tim_read(const struct sim_periph *periph, size_t off)
+{
+    volatile struct tim *tim = periph->regs;
+    if (off == offsetof(struct tim, cnt) && (tim->cr1 & TIM_CR1_CEN_MASK)) {
+        tim->cnt = sim_tim_counts(tim) % ((tim->arr & 0xffff) + 1);
+    }
+}
+
+/**
+ * Handle a timer register write.
+ *
+ * @param periph    The timer description.
+ * @param off       Offset of the written register.
+ */
+static void
+sim_tim_write(const struct sim_periph *periph, size_t off)
+{
+    volatile struct tim *tim = periph->regs;
+    uint32_t cnt;
+
+    if (off == offsetof(struct tim, sr)) {
+        /* Flags can only be cleared, by writing zeroes */
+        SIM_TIM2_SR &= tim->sr;
+        tim->sr = SIM_TIM2_SR;
+    } else if (off == offsetof(struct tim, egr)) {
+        if (tim->egr & TIM_EGR_UG_MASK) {
+            sim_tim_rebase(tim, 0);
+        }
+        tim->egr = 0;
+    } else if (off == offsetof(struct tim, cnt)) {
+        sim_tim_rebase(tim, tim->cnt & 0xffff);
+    } else if (off == offsetof(struct tim, cr1) ||
+               off == offsetof(struct tim, psc) ||
+               off == offsetof(struct tim, arr)) {
+        /* Continue from the current count, with the new settings */
+        sim_tim_read(periph, offsetof(struct tim, cnt));
+        cnt = tim->cnt;
+        sim_tim_rebase(tim, cnt);
+    }
+}
+
+/**
+ * Get the number of counts since the counter base, at which the next
+ * event matching a counter value occurs.
+ *
+ * @param tim   The timer registers.
+ * @param value The counter value to match.
+ *
+ * @return The number of counts, or UINT64_MAX if never.
+ */
+static uint64_t
+sim_tim_match(volatile struct tim *tim, uint32_t value)
+{
+    uint64_t period = (uint64_t)(tim->arr & 0xffff) + 1;
+    /* Skip the counts passed, and the last one handled */
+    uint64_t counts = MAX(SIM_TIM2_LAST, sim_tim_counts(tim)) + 1;
+    uint64_t phase;
+
+    if (value >= period) {
+        return UINT64_MAX;
+    }
+    phase = counts % period;
+    return counts + (value + period - phase) % period;
+}
+
+/**
+ * Get the number of counts since the counter base, at which the next
+ * enabled interrupt fires.
+ *
+ * @param tim   The timer registers.
+ *
+ * @return The number of counts, or UINT64_MAX if none are enabled.
+ */
+static uint64_t
+sim_tim_next_counts(volatile struct tim *tim)
+{
+    uint64_t counts = UINT64_MAX;
+
+    if (tim->dier & TIM_DIER_UIE_MASK) {
+        counts = MIN(counts, sim_tim_match(tim, 0));
+    }
+    if (tim->dier & TIM_DIER_CC1IE_MASK) {
+        counts = MIN(counts, sim_tim_match(tim, tim->ccr1));
+    }
+    if (tim->dier & TIM_DIER_CC2IE_MASK) {
+        counts = MIN(counts, sim_tim_match(tim, tim->ccr2));
+    }
+    if (tim->dier & TIM_DIER_CC3IE_MASK) {
+        counts = MIN(counts, sim_tim_match(tim, tim->ccr3));
+    }
+    if (tim->dier & TIM_DIER_CC4IE_MASK) {
+        counts = MIN(counts, sim_tim_match(tim, tim->ccr4));
+    }
+    return counts;
+}
+
+/**
+ * Get the virtual time of the next timer interrupt.
+ *
+ * @param periph    The timer description.
+ *
+ * @return The time of the next interrupt, or UINT64_MAX if none.
+ */
+static uint64_t
+sim_tim_next(const struct sim_periph *periph)
+{
+    volatile struct tim *tim = periph->regs;
+    uint64_t counts;
+
+    if (!(tim->cr1 & TIM_CR1_CEN_MASK)) {
+        return UINT64_MAX;
+    }
+    counts = sim_tim_next_counts(tim);
+    return counts == UINT64_MAX
+                ? UINT64_MAX : SIM_TIM2_BASE + counts * sim_tim_div(tim);
+}
+
+/**
+ * Set the flags of the interrupts due, and fire the interrupt.
+ *
+ * @param periph    The timer description.
+ */
+static void
+sim_tim_event(const struct sim_periph *periph)
+{
+    volatile struct tim *tim = periph->regs;
+    /* The event is due at the start of the current count */
+    uint64_t counts = sim_tim_counts(tim);
+    uint32_t cnt = counts % ((tim->arr & 0xffff) + 1);
+
+    SIM_TIM2_LAST = counts;
+    tim->cnt = cnt;
+    if ((tim->dier & TIM_DIER_UIE_MASK) && cnt == 0) {
+        SIM_TIM2_SR |= TIM_SR_UIF_MASK;
+    }
+    if ((tim->dier & TIM_DIER_CC1IE_MASK) && cnt == tim->ccr1) {
+        SIM_TIM2_SR |= TIM_SR_CC1IF_MASK;
+    }
+    if ((tim->dier & TIM_DIER_CC2IE_MASK) && cnt == tim->ccr2) {
+        SIM_TIM2_SR |= TIM_SR_CC2IF_MASK;
+    }
+    if ((tim->dier & TIM_DIER_CC3IE_MASK) && cnt == tim->ccr3) {
+        SIM_TIM2_SR |= TIM_SR_CC3IF_MASK;
+    }
+    if ((tim->dier & TIM_DIER_CC4IE_MASK) && cnt == tim->ccr4) {
+        SIM_TIM2_SR |= TIM_SR_CC4IF_MASK;
+    }
+    tim->sr = SIM_TIM2_SR;
+
+    if (sim_nvic_enabled(NVIC_INT_TIM2) && tim2_handler != NULL) {
+        SIM_TIM2_IRQS++;
+        tim2_handler();
+    }
+}
+
+/**
+ * Output timer statistics.
+ *
+ * @param periph    The timer description.
+ * @param stream    The stream to output to.
+ */
+static void
+sim_tim_report(const struct sim_periph *periph, FILE *stream)
+{
+    fprintf(stream, "%s: %" PRIu64 " interrupts\n",
+            periph->name, SIM_TIM2_IRQS);
+}
+
+const struct sim_periph SIM_TIM2_PERIPH = {
+    .name = "tim2",
+    .regs = &SIM_TIM2,
+    .size = sizeof(SIM_TIM2),
+    .init = sim_tim_init,
+    .read = sim_tim_read,
+    .write = sim_tim_write,
+    .next = sim_tim_next,
+    .event = sim_tim_event,
+    .report = sim_tim_report,
+};
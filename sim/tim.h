@@ -0,0 +1,68 @@
+/*
+ * General-purpose timers (TIM2-TIM4) - host stand-in for libstammer
+ */
+
+#ifndef _TIM_H
+#define _TIM_H
+
+#include <stdint.h>
+
+/** General-purpose timer registers */
+struct tim {
+    uint32_t cr1;
+    uint32_t cr2;
+    uint32_t smcr;
+    uint32_t dier;
+    uint32_t sr;
+    uint32_t egr;
+    uint32_t ccmr1;
+    uint32_t ccmr2;
+    uint32_t ccer;
+    uint32_t cnt;
+    uint32_t psc;
+    uint32_t arr;
+    uint32_t reserved1;
+    uint32_t ccr1;
+    uint32_t ccr2;
+    uint32_t ccr3;
+    uint32_t ccr4;
+    uint32_t reserved2;
+    uint32_t dcr;
+    uint32_t dmar;
+};
+
+/* Control register 1 */
+#define TIM_CR1_CEN_MASK    (1 << 0)
+#define TIM_CR1_UDIS_MASK   (1 << 1)
+#define TIM_CR1_URS_MASK    (1 << 2)
+#define TIM_CR1_OPM_MASK    (1 << 3)
+#define TIM_CR1_DIR_MASK    (1 << 4)
+#define TIM_CR1_ARPE_MASK   (1 << 7)
+
+/* DMA/interrupt enable register */
+#define TIM_DIER_UIE_MASK   (1 << 0)
+#define TIM_DIER_CC1IE_MASK (1 << 1)
+#define TIM_DIER_CC2IE_MASK (1 << 2)
+#define TIM_DIER_CC3IE_MASK (1 << 3)
+#define TIM_DIER_CC4IE_MASK (1 << 4)
+
+/* Status register */
+#define TIM_SR_UIF_MASK     (1 << 0)
+#define TIM_SR_CC1IF_MASK   (1 << 1)
+#define TIM_SR_CC2IF_MASK   (1 << 2)
+#define TIM_SR_CC3IF_MASK   (1 << 3)
+#define TIM_SR_CC4IF_MASK   (1 << 4)
+
+/* Event generation register */
+#define TIM_EGR_UG_MASK     (1 << 0)
+
+/** Simulated TIM2 registers */
+extern volatile struct tim SIM_TIM2;
+
+/** TIM2 */
+#define TIM2 (&SIM_TIM2)
+
+/** Simulated TIM2 description */
+extern const struct sim_periph SIM_TIM2_PERIPH;
+
+#endif /* _TIM_H */
@@ -0,0 +1,317 @@
+/*
+ * Simulated chain of TLC5916 LED drivers
+ */
+
+#include "sim.h"
+#include "tlc5916.h"
+#include <string.h>
+#include <inttypes.h>
+
+/** Number of outputs in the chain */
+#define SIM_TLC5916_OUT_NUM (SIM_TLC5916_NUM * 8)
+
+/** GPIO port the chain control lines are connected to */
+#define SIM_TLC5916_GPIO    GPIO_A
+
+/** GPIO pin connected to LE */
+#define SIM_TLC5916_LE_PIN  4
+
+/** GPIO pin connected to CLK, when configured as general-purpose output */
+#define SIM_TLC5916_CLK_PIN 5
+
+/** GPIO pin connected to SDI, when configured as general-purpose output */
+#define SIM_TLC5916_SDI_PIN 7
+
+/** GPIO pin connected to OE, with LEDS_GAIN */
+#define SIM_TLC5916_OE_PIN  3
+
+/**
+ * OE levels sampled on the last five CLK rising edges, the latest in the
+ * lowest bit, switching modes: high, low, high, high, high.
+ */
+#define SIM_TLC5916_SWITCH_OE       0x17
+
+/** LE levels sampled along with SIM_TLC5916_SWITCH_OE, for special mode */
+#define SIM_TLC5916_SWITCH_LE_SPECIAL   0x02
+
+/** LE levels sampled along with SIM_TLC5916_SWITCH_OE, for normal mode */
+#define SIM_TLC5916_SWITCH_LE_NORMAL    0x00
+
+/**
+ * Shift register contents of each driver, in the order of the chain.
+ * The byte shifted in first ends up in the last driver.
+ */
+static uint8_t SIM_TLC5916_SHIFT[SIM_TLC5916_NUM];
+
+/** Output latch contents of each driver, in the order of the chain */
+static uint8_t SIM_TLC5916_OUT[SIM_TLC5916_NUM];
+
+/** Configuration latch contents of each driver, in the order of the chain */
+static uint8_t SIM_TLC5916_CONF[SIM_TLC5916_NUM];
+
+/** True if the chain is in special mode, latching configuration */
+static bool SIM_TLC5916_SPECIAL;
+
+/** Current LE level */
+static bool SIM_TLC5916_LE;
+
+/** Current OE level, high turning the outputs off */
+static bool SIM_TLC5916_OE;
+
+/** Current CLK level, driven as general-purpose output */
+static bool SIM_TLC5916_CLK;
+
+/** OE levels sampled on the last CLK rising edges, the latest lowest */
+static uint8_t SIM_TLC5916_OE_HIST;
+
+/** LE levels sampled on the last CLK rising edges, the latest lowest */
+static uint8_t SIM_TLC5916_LE_HIST;
+
+/** Number of LE pulses */
+static uint64_t SIM_TLC5916_LATCHES;
+
+/** Number of output latch changes */
+static uint64_t SIM_TLC5916_CHANGES;
+
+/** Number of mode switches */
+static uint64_t SIM_TLC5916_SWITCHES;
+
+/** Number of configuration latch changes */
+static uint64_t SIM_TLC5916_CONF_CHANGES;
+
+/** Virtual time of the last output time accounting */
+static uint64_t SIM_TLC5916_TIME;
+
+/** Time each output spent on, HCLK cycles, in the order of data bits */
+static uint64_t SIM_TLC5916_ON_TIME[SIM_TLC5916_OUT_NUM];
+
+/**
+ * Time each output spent on, HCLK cycles, times the current gain, in the
+ * order of data bits
+ */
+static double SIM_TLC5916_LIGHT[SIM_TLC5916_OUT_NUM];
+
+/**
+ * Get the output current gain set by a configuration code.
+ *
+ * @param code  The configuration code: CM in bit 0, HC in bit 1, and the
+ *              gain adjustment from the most significant bit (CC0) in bit
+ *              2 to the least significant one (CC5) in bit 7.
+ *
+ * @return The gain.
+ */
+static double
+sim_tlc5916_gain(uint8_t code)
+{
+    unsigned int d = 0;
+    unsigned int bit;
+
+    for (bit = 2; bit < 8; bit++) {
+        d = (d << 1) | ((code >> bit) & 1);
+    }
+    return (1 + ((code >> 1) & 1)) * (1 + d / 64.0) / 4 /
+           ((code & 1) ? 1 : 3);
+}
+
+/**
+ * Account the time the outputs spent in the current state.
+ */
+static void
+sim_tlc5916_account(void)
+{
+    size_t i;
+    size_t drv;
+    uint64_t time = SIM_TIME - SIM_TLC5916_TIME;
+
+    SIM_TLC5916_TIME = SIM_TIME;
+    /* The outputs are off while OE is high */
+    if (SIM_TLC5916_OE) {
+        return;
+    }
+    for (i = 0; i < SIM_TLC5916_OUT_NUM; i++) {
+        drv = SIM_TLC5916_NUM - 1 - (i >> 3);
+        if (SIM_TLC5916_OUT[drv] & (1 << (i & 7))) {
+            SIM_TLC5916_ON_TIME[i] += time;
+            SIM_TLC5916_LIGHT[i] +=
+                time * sim_tlc5916_gain(SIM_TLC5916_CONF[drv]);
+        }
+    }
+}
+
+/**
+ * Latch the shift register contents into the outputs, or, in special
+ * mode, into the configuration.
+ */
+static void
+sim_tlc5916_latch(void)
+{
+    uint8_t *latch = SIM_TLC5916_SPECIAL ? SIM_TLC5916_CONF
+                                         : SIM_TLC5916_OUT;
+
+    if (memcmp(latch, SIM_TLC5916_SHIFT, sizeof(SIM_TLC5916_SHIFT)) == 0) {
+        return;
+    }
+    sim_tlc5916_account();
+    memcpy(latch, SIM_TLC5916_SHIFT, sizeof(SIM_TLC5916_SHIFT));
+    if (SIM_TLC5916_SPECIAL) {
+        SIM_TLC5916_CONF_CHANGES++;
+    } else {
+        SIM_TLC5916_CHANGES++;
+    }
+}
+
+/**
+ * Clock a bit into the chain, switching modes on the right sequence of OE
+ * and LE levels.
+ *
+ * @param sdi   The bit to shift in through the first driver's SDI.
+ *
+ * @return The bit shifted out through the last driver's SDO.
+ */
+static uint8_t
+sim_tlc5916_clock(uint8_t sdi)
+{
+    uint8_t sdo = SIM_TLC5916_SHIFT[SIM_TLC5916_NUM - 1] >> 7;
+    size_t i;
+
+    for (i = SIM_TLC5916_NUM - 1; i > 0; i--) {
+        SIM_TLC5916_SHIFT[i] = (SIM_TLC5916_SHIFT[i] << 1) |
+                               (SIM_TLC5916_SHIFT[i - 1] >> 7);
+    }
+    SIM_TLC5916_SHIFT[0] = (SIM_TLC5916_SHIFT[0] << 1) | sdi;
+
+    SIM_TLC5916_OE_HIST = ((SIM_TLC5916_OE_HIST << 1) |
+                           SIM_TLC5916_OE) & 0x1f;
+    SIM_TLC5916_LE_HIST = ((SIM_TLC5916_LE_HIST << 1) |
+                           SIM_TLC5916_LE) & 0x1f;
+    if (SIM_TLC5916_OE_HIST == SIM_TLC5916_SWITCH_OE &&
+        (SIM_TLC5916_LE_HIST == SIM_TLC5916_SWITCH_LE_SPECIAL ||
+         SIM_TLC5916_LE_HIST == SIM_TLC5916_SWITCH_LE_NORMAL)) {
+        SIM_TLC5916_SPECIAL =
+            SIM_TLC5916_LE_HIST == SIM_TLC5916_SWITCH_LE_SPECIAL;
+        SIM_TLC5916_SWITCHES++;
+    }
+
+    return sdo;
+}
+
+uint8_t
+sim_tlc5916_shift(uint8_t byte)
+{
+    uint8_t out = 0;
+    int bit;
+
+    for (bit = 7; bit >= 0; bit--) {
+        out = (out << 1) | sim_tlc5916_clock((byte >> bit) & 1);
+    }
+    /* The latches are transparent while LE is high */
+    if (SIM_TLC5916_LE) {
+        sim_tlc5916_latch();
+    }
+    return out;
+}
+
+void
+sim_tlc5916_gpio(volatile struct gpio *gpio)
+{
+    bool le;
+    bool oe;
+    bool clk;
+
+    if (gpio != SIM_TLC5916_GPIO) {
+        return;
+    }
+
+    le = (gpio->odr >> SIM_TLC5916_LE_PIN) & 1;
+    oe = (gpio->odr >> SIM_TLC5916_OE_PIN) & 1;
+    /* CLK follows the pin only while it's a general-purpose output */
+    clk = !(gpio->crl & (0x8u << (SIM_TLC5916_CLK_PIN * 4))) &&
+          (gpio->odr >> SIM_TLC5916_CLK_PIN) & 1;
+
+    if (oe != SIM_TLC5916_OE) {
+        sim_tlc5916_account();
+        SIM_TLC5916_OE = oe;
+    }
+    if (le && !SIM_TLC5916_LE) {
+        SIM_TLC5916_LATCHES++;
+        sim_tlc5916_latch();
+    }
+    SIM_TLC5916_LE = le;
+    if (clk && !SIM_TLC5916_CLK) {
+        sim_tlc5916_clock((gpio->odr >> SIM_TLC5916_SDI_PIN) & 1);
+    }
+    SIM_TLC5916_CLK = clk;
+}
+
+/**
+ * Reset the chain.
+ *
+ * @param periph    The chain description.
+ */
+static void
+sim_tlc5916_init(const struct sim_periph *periph)
+{
+    (void)periph;
+    memset(SIM_TLC5916_SHIFT, 0, sizeof(SIM_TLC5916_SHIFT));
+    memset(SIM_TLC5916_OUT, 0, sizeof(SIM_TLC5916_OUT));
+    /* Configuration codes are all ones at power-up */
+    memset(SIM_TLC5916_CONF, 0xff, sizeof(SIM_TLC5916_CONF));
+    memset(SIM_TLC5916_ON_TIME, 0, sizeof(SIM_TLC5916_ON_TIME));
+    memset(SIM_TLC5916_LIGHT, 0, sizeof(SIM_TLC5916_LIGHT));
+    SIM_TLC5916_SPECIAL = false;
+    SIM_TLC5916_LE = false;
+    SIM_TLC5916_OE = false;
+    SIM_TLC5916_CLK = false;
+    SIM_TLC5916_OE_HIST = 0;
+    SIM_TLC5916_LE_HIST = 0;
+    SIM_TLC5916_LATCHES = 0;
+    SIM_TLC5916_CHANGES = 0;
+    SIM_TLC5916_SWITCHES = 0;
+    SIM_TLC5916_CONF_CHANGES = 0;
+    SIM_TLC5916_TIME = SIM_TIME;
+}
+
+/**
+ * Output chain statistics: latch counts, the mode switches and the current
+ * gain of each driver, the average duty cycle of each output, and its
+ * average light output, relative to full gain, in percent, in the order of
+ * LED indexes.
+ *
+ * @param periph    The chain description.
+ * @param stream    The stream to output to.
+ */
+static void
+sim_tlc5916_report(const struct sim_periph *periph, FILE *stream)
+{
+    size_t i;
+
+    sim_tlc5916_account();
+    fprintf(stream, "%s: %" PRIu64 " latches, %" PRIu64 " output changes\n",
+            periph->name, SIM_TLC5916_LATCHES, SIM_TLC5916_CHANGES);
+    fprintf(stream, "%s: duty, %%:", periph->name);
+    for (i = 0; i < SIM_TLC5916_OUT_NUM; i++) {
+        fprintf(stream, "%s%.1f", (i & 7) ? " " : "\n    ",
+                SIM_TIME ? SIM_TLC5916_ON_TIME[i] * 100.0 / SIM_TIME : 0);
+    }
+    fprintf(stream, "\n");
+    fprintf(stream, "%s: %" PRIu64 " mode switches, "
+                    "%" PRIu64 " configuration changes, gain:",
+            periph->name, SIM_TLC5916_SWITCHES, SIM_TLC5916_CONF_CHANGES);
+    for (i = 0; i < SIM_TLC5916_NUM; i++) {
+        fprintf(stream, " %.3f",
+                sim_tlc5916_gain(SIM_TLC5916_CONF[SIM_TLC5916_NUM - 1 - i]));
+    }
+    fprintf(stream, "\n");
+    fprintf(stream, "%s: light, %%:", periph->name);
+    for (i = 0; i < SIM_TLC5916_OUT_NUM; i++) {
+        fprintf(stream, "%s%.1f", (i & 7) ? " " : "\n    ",
+                SIM_TIME ? SIM_TLC5916_LIGHT[i] * 100.0 / SIM_TIME : 0);
+    }
+    fprintf(stream, "\n");
+}
+
+const struct sim_periph SIM_TLC5916_PERIPH = {
+    .name = "tlc5916",
+    .init = sim_tlc5916_init,
+    .report = sim_tlc5916_report,
+};
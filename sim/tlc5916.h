@@ -0,0 +1,42 @@
+/*
+ * Simulated chain of TLC5916 LED drivers
+ *
+ * Wired as on the card: A4 - LE, A5 - CLK, A6 - SDO of the last driver,
+ * A7 - SDI of the first driver, and, with LEDS_GAIN, A3 - OE.
+ */
+
+#ifndef _TLC5916_H
+#define _TLC5916_H
+
+#include <gpio.h>
+#include <stdint.h>
+
+/** Number of drivers in the chain, as many as the firmware drives */
+#ifndef SIM_TLC5916_NUM
+#ifdef LEDS_DRV_NUM
+#define SIM_TLC5916_NUM LEDS_DRV_NUM
+#else
+#define SIM_TLC5916_NUM 5
+#endif
+#endif
+
+/**
+ * Shift a byte into the chain, most significant bit first.
+ *
+ * @param byte  The byte to shift in through the first driver's SDI.
+ *
+ * @return The byte shifted out through the last driver's SDO.
+ */
+extern uint8_t sim_tlc5916_shift(uint8_t byte);
+
+/**
+ * Notify the chain of a GPIO port output or configuration change.
+ *
+ * @param gpio  The changed GPIO port.
+ */
+extern void sim_tlc5916_gpio(volatile struct gpio *gpio);
+
+/** Simulated driver chain description */
+extern const struct sim_periph SIM_TLC5916_PERIPH;
+
+#endif /* _TLC5916_H */
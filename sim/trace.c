@@ -0,0 +1,222 @@
+/*
+ * Simulated LED frame trace recorder and checker
+ */
+
+#include "sim.h"
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+/** Maximum number of LEDS_BR entries in a trace line */
+#define SIM_TRACE_BR_MAX    256
+
+/** Maximum length of a trace line, including the newline and the zero */
+#define SIM_TRACE_LINE_MAX  (64 + SIM_TRACE_BR_MAX * 2)
+
+/** Trace being recorded, or NULL if not recording */
+static FILE *SIM_TRACE_RECORD;
+
+/** Reference trace being checked against, or NULL if not checking */
+static FILE *SIM_TRACE_CHECK;
+
+/** Name of the reference trace file */
+static const char *SIM_TRACE_CHECK_NAME;
+
+/** Number of swaps seen so far */
+static uint64_t SIM_TRACE_SWAPS;
+
+/** Number of swaps found matching the reference */
+static uint64_t SIM_TRACE_MATCHES;
+
+/**
+ * Calculate the 32-bit FNV-1a hash of a memory block.
+ *
+ * @param ptr   The block to hash.
+ * @param size  Size of the block, bytes.
+ *
+ * @return The hash.
+ */
+static uint32_t
+sim_trace_fnv1a(const volatile void *ptr, size_t size)
+{
+    const volatile uint8_t *p = ptr;
+    uint32_t hash = 2166136261u;
+
+    while (size--) {
+        hash = (hash ^ *p++) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Format a swap trace line, without the newline.
+ *
+ * @param buf       The buffer to format into, SIM_TRACE_LINE_MAX bytes.
+ * @param br        The brightness array.
+ * @param br_num    Number of entries in the brightness array.
+ * @param checksum  The checksum of the bank swapped in.
+ */
+static void
+sim_trace_format(char *buf, const uint8_t *br, size_t br_num,
+                 uint32_t checksum)
+{
+    size_t i;
+
+    buf += sprintf(buf, "%" PRIu64 " %" PRIu64 " ", SIM_TRACE_SWAPS,
+                   SIM_TIME / (SIM_HCLK_HZ / 1000));
+    for (i = 0; i < br_num; i++) {
+        buf += sprintf(buf, "%02x", br[i]);
+    }
+    sprintf(buf, " %08" PRIx32, checksum);
+}
+
+/**
+ * Explain the first difference of a trace line from the reference, and
+ * exit the simulation.
+ *
+ * @param line  The trace line.
+ * @param ref   The reference trace line.
+ */
+static void
+sim_trace_diverge(const char *line, const char *ref)
+{
+    uint64_t swaps, time;
+    char br[SIM_TRACE_BR_MAX * 2 + 1];
+    char ref_br[SIM_TRACE_BR_MAX * 2 + 1];
+    uint32_t checksum, ref_checksum;
+    uint64_t ref_time;
+    size_t i;
+
+    fprintf(stderr, "trace: swap %" PRIu64 " differs from %s\n"
+                    "trace: expected %s\n"
+                    "trace: got      %s\n",
+            SIM_TRACE_SWAPS, SIM_TRACE_CHECK_NAME, ref, line);
+    if (sscanf(line, "%" SCNu64 " %" SCNu64 " %512s %" SCNx32,
+               &swaps, &time, br, &checksum) == 4 &&
+        sscanf(ref, "%" SCNu64 " %" SCNu64 " %512s %" SCNx32,
+               &swaps, &ref_time, ref_br, &ref_checksum) == 4) {
+        if (time != ref_time) {
+            fprintf(stderr, "trace: time differs by %+" PRId64 " ms\n",
+                    (int64_t)(time - ref_time));
+        }
+        if (strcmp(br, ref_br) != 0) {
+            fprintf(stderr, "trace: brightness differs for LEDs:");
+            for (i = 0; br[i] != 0 && ref_br[i] != 0; i += 2) {
+                if (br[i] != ref_br[i] || br[i + 1] != ref_br[i + 1]) {
+                    fprintf(stderr, " %zu", i / 2);
+                }
+            }
+            fprintf(stderr, "\n");
+        }
+        if (checksum != ref_checksum) {
+            fprintf(stderr, "trace: bank checksum differs\n");
+        }
+    }
+    exit(1);
+}
+
+void
+sim_trace_swap(const uint8_t *br, size_t br_num,
+               const volatile void *bank, size_t bank_size)
+{
+    char line[SIM_TRACE_LINE_MAX];
+    char ref[SIM_TRACE_LINE_MAX];
+
+    if (br_num > SIM_TRACE_BR_MAX) {
+        br_num = SIM_TRACE_BR_MAX;
+    }
+    sim_trace_format(line, br, br_num, sim_trace_fnv1a(bank, bank_size));
+
+    if (SIM_TRACE_RECORD != NULL) {
+        fprintf(SIM_TRACE_RECORD, "%s\n", line);
+    }
+
+    if (SIM_TRACE_CHECK != NULL) {
+        if (fgets(ref, sizeof(ref), SIM_TRACE_CHECK) == NULL) {
+            /* Ran past the end of the reference, stop checking */
+            fclose(SIM_TRACE_CHECK);
+            SIM_TRACE_CHECK = NULL;
+        } else {
+            ref[strcspn(ref, "\n")] = 0;
+            if (strcmp(line, ref) != 0) {
+                sim_trace_diverge(line, ref);
+            }
+            SIM_TRACE_MATCHES++;
+        }
+    }
+
+    SIM_TRACE_SWAPS++;
+}
+
+/**
+ * Open the trace files requested by the environment.
+ *
+ * @param periph    The recorder description.
+ */
+static void
+sim_trace_init(const struct sim_periph *periph)
+{
+    const char *name;
+    uint32_t seed;
+
+    (void)periph;
+    SIM_TRACE_SWAPS = 0;
+    SIM_TRACE_MATCHES = 0;
+
+    name = getenv("SIM_TRACE_RECORD");
+    if (name != NULL) {
+        SIM_TRACE_RECORD = fopen(name, "w");
+        if (SIM_TRACE_RECORD == NULL) {
+            perror(name);
+            exit(1);
+        }
+        fprintf(SIM_TRACE_RECORD, "seed %" PRIu32 "\n", SIM_SEED);
+    }
+
+    name = getenv("SIM_TRACE_CHECK");
+    if (name != NULL) {
+        SIM_TRACE_CHECK_NAME = name;
+        SIM_TRACE_CHECK = fopen(name, "r");
+        if (SIM_TRACE_CHECK == NULL) {
+            perror(name);
+            exit(1);
+        }
+        if (fscanf(SIM_TRACE_CHECK, "seed %" SCNu32 "\n", &seed) != 1) {
+            fprintf(stderr, "trace: %s is not a trace\n", name);
+            exit(1);
+        }
+        if (seed != SIM_SEED) {
+            fprintf(stderr, "trace: %s is recorded with seed %" PRIu32
+                            ", simulating seed %" PRIu32 "\n",
+                    name, seed, SIM_SEED);
+            exit(1);
+        }
+    }
+}
+
+/**
+ * Output the number of swaps recorded and checked.
+ *
+ * @param periph    The recorder description.
+ * @param stream    The stream to output to.
+ */
+static void
+sim_trace_report(const struct sim_periph *periph, FILE *stream)
+{
+    if (SIM_TRACE_RECORD != NULL) {
+        fflush(SIM_TRACE_RECORD);
+        fprintf(stream, "%s: %" PRIu64 " swaps recorded\n",
+                periph->name, SIM_TRACE_SWAPS);
+    }
+    if (SIM_TRACE_CHECK_NAME != NULL) {
+        fprintf(stream, "%s: %" PRIu64 " swaps match %s\n",
+                periph->name, SIM_TRACE_MATCHES, SIM_TRACE_CHECK_NAME);
+    }
+}
+
+const struct sim_periph SIM_TRACE_PERIPH = {
+    .name = "trace",
+    .init = sim_trace_init,
+    .report = sim_trace_report,
+};
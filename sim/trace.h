@@ -0,0 +1,26 @@
+/*
+ * Simulated LED frame trace recorder and checker
+ *
+ * Records every PWM bank swap to the file named by the SIM_TRACE_RECORD
+ * environment variable, and/or compares every swap to the ones recorded in
+ * the file named by SIM_TRACE_CHECK, exiting the simulation on the first
+ * difference. The trace is text, starting with a "seed SEED" line,
+ * followed by one line per swap:
+ *
+ *      SWAP TIME BR CHECKSUM
+ *
+ * Where SWAP is the swap number starting from zero, TIME is the virtual
+ * time of the swap in whole milliseconds, BR is the LEDS_BR array in hex,
+ * two digits per LED, and CHECKSUM is the 32-bit FNV-1a hash of the bank
+ * swapped in, in hex. The time is coarse enough to ignore PWM engines
+ * swapping a tick apart, but the bank layout differs between linear PWM
+ * and LEDS_BCM, and so do the checksums.
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+/** Simulated trace recorder description */
+extern const struct sim_periph SIM_TRACE_PERIPH;
+
+#endif /* _TRACE_H */
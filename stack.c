@@ -0,0 +1,119 @@
+/*
+ * Stack usage instrumentation
+ */
+
+#include "stack.h"
+#include <stdint.h>
+
+#ifndef HOST
+
+/** Word the unused stack is painted with */
+#define STACK_PAINT 0xc5c5c5c5
+
+/**
+ * Number of words right below the stack pointer left unpainted by
+ * stack_init(), for its own use.
+ */
+#define STACK_PAINT_MARGIN  16
+
+/**
+ * The vector table in flash, starting with the initial main stack
+ * pointer, that is the top of the main stack.
+ */
+#define STACK_VECTORS   ((const volatile uint32_t *)0x08000000)
+
+/** Interrupt handler stack */
+static volatile uint32_t STACK_ISR[STACK_ISR_SIZE / 4];
+
+/** Bottom of the main stack */
+static volatile uint32_t *STACK_MAIN_BOTTOM;
+
+/**
+ * Get the number of bytes used in a painted stack.
+ *
+ * @param bottom    The lowest word of the stack.
+ * @param top       The word above the highest word of the stack.
+ *
+ * @return The number of bytes from the lowest overwritten word to the top.
+ */
+static size_t
+stack_used(const volatile uint32_t *bottom, const volatile uint32_t *top)
+{
+    const volatile uint32_t *p;
+    for (p = bottom; p < top && *p == STACK_PAINT; p++);
+    return (top - p) * 4;
+}
+
+void
+stack_init(void)
+{
+    volatile uint32_t *top = (volatile uint32_t *)STACK_VECTORS[0];
+    volatile uint32_t *sp;
+    volatile uint32_t *p;
+
+    /* Paint the main stack, below what is in use */
+    asm volatile ("mov %0, sp" : "=r" (sp));
+    STACK_MAIN_BOTTOM = top - STACK_MAIN_SIZE / 4;
+    for (p = STACK_MAIN_BOTTOM; p < sp - STACK_PAINT_MARGIN; p++) {
+        *p = STACK_PAINT;
+    }
+
+    /* Paint the interrupt handler stack */
+    for (p = STACK_ISR; p < STACK_ISR + STACK_ISR_SIZE / 4; p++) {
+        *p = STACK_PAINT;
+    }
+
+    /*
+     * Continue in thread mode on the process stack pointer, set to the
+     * current main stack pointer, and point the main stack pointer,
+     * used by the handlers, to the interrupt handler stack.
+     */
+    asm volatile ("mrs r0, msp\n"
+                  "msr psp, r0\n"
+                  "movs r0, #2\n"
+                  "msr control, r0\n"
+                  "isb\n"
+                  "msr msp, %0\n"
+                  :
+                  : "r" (STACK_ISR + STACK_ISR_SIZE / 4)
+                  : "r0", "memory");
+}
+
+size_t
+stack_main_used(void)
+{
+    return stack_used(STACK_MAIN_BOTTOM,
+                      STACK_MAIN_BOTTOM + STACK_MAIN_SIZE / 4);
+}
+
+size_t
+stack_isr_used(void)
+{
+    return stack_used(STACK_ISR, STACK_ISR + STACK_ISR_SIZE / 4);
+}
+
+#else /* HOST */
+
+/*
+ * The simulator runs the firmware on the host stack, there is nothing to
+ * measure.
+ */
+
+void
+stack_init(void)
+{
+}
+
+size_t
+stack_main_used(void)
+{
+    return 0;
+}
+
+size_t
+stack_isr_used(void)
+{
+    return 0;
+}
+
+#endif /* HOST */
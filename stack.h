@@ -0,0 +1,55 @@
+/*
+ * Stack usage instrumentation
+ *
+ * The main loop runs on the stack set up by the startup code, at the top
+ * of RAM, switched to the process stack pointer, and interrupt handlers
+ * run on a separate, statically-allocated stack. Both are painted with a
+ * pattern at boot, so the deepest use of each can be found later by
+ * looking for the first overwritten word.
+ */
+
+#ifndef _STACK_H
+#define _STACK_H
+
+#include <stddef.h>
+
+/** Size of the main stack, bytes, to paint and to budget RAM for */
+#ifndef STACK_MAIN_SIZE
+#define STACK_MAIN_SIZE 2048
+#endif
+
+/** Size of the interrupt handler stack, bytes */
+#ifndef STACK_ISR_SIZE
+#define STACK_ISR_SIZE  512
+#endif
+
+#if STACK_MAIN_SIZE % 4 != 0 || STACK_ISR_SIZE % 4 != 0
+#error "Stack sizes must be multiples of four bytes"
+#endif
+
+/**
+ * Paint the stacks and move interrupt handlers to their own stack. Must
+ * be called in main() right after init(), which clears .bss, holding the
+ * interrupt handler stack, and before interrupts are enabled.
+ */
+extern void stack_init(void);
+
+/**
+ * Get the high-water mark of the main stack.
+ *
+ * @return Maximum number of bytes of the main stack used so far,
+ *         STACK_MAIN_SIZE if it might have overflowed, or zero on the
+ *         host.
+ */
+extern size_t stack_main_used(void);
+
+/**
+ * Get the high-water mark of the interrupt handler stack.
+ *
+ * @return Maximum number of bytes of the interrupt handler stack used so
+ *         far, STACK_ISR_SIZE if it might have overflowed, or zero on the
+ *         host.
+ */
+extern size_t stack_isr_used(void);
+
+#endif /* _STACK_H */